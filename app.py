@@ -1,12 +1,109 @@
 from flask import Flask, render_template, request, jsonify
 import sys
 import io
+import os
 import subprocess
 import json
+import hashlib
+import re
+import stat
+import tempfile
+import time
 from minic_compiler_new import MiniCCompiler
 
+# Prefer the in-process C++ backend (built by backend_cpp/CMakeLists.txt and
+# copied next to the sources by build.ps1) over spawning minic_backend.exe.
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), 'backend_cpp'))
+try:
+    import minic_native
+except ImportError:
+    minic_native = None
+
 app = Flask(__name__)
 
+# Limits on running a submitted program (Budget in backend_cpp/minic.h). A
+# program that hits one comes back with a "budget_exceeded" entry, its errors
+# and the output it printed so far.
+RUN_LIMITS = {'max_steps': 50000000, 'max_time_ms': 5000, 'max_depth': 1000, 'max_output': 1 << 20,
+              'max_memory': 256 << 20}
+# Backstop for the minic_backend process itself, in seconds
+BACKEND_TIMEOUT = 15
+BACKEND_EXE = r'backend_cpp\\minic_backend.exe'
+
+
+def private_dir(name):
+    """A directory in the temp dir that only this user can write. The temp
+    dir is shared, so a fixed name is only reused if this user created it
+    and nobody else can write to it; otherwise a fresh one is made."""
+    path = os.path.join(tempfile.gettempdir(), name)
+    if not hasattr(os, 'getuid'):
+        # Windows: the temp dir is already per user
+        os.makedirs(path, exist_ok=True)
+        return path
+    try:
+        os.mkdir(path, 0o700)
+    except FileExistsError:
+        pass
+    st = os.lstat(path)
+    if not stat.S_ISDIR(st.st_mode) or st.st_uid != os.getuid() or st.st_mode & 0o022:
+        return tempfile.mkdtemp(prefix=name + '_')
+    return path
+
+
+# Submitted programs may only import modules from this library directory;
+# their compiled interfaces are cached outside it, where no other user can
+# plant one
+MODULE_OPTIONS = {
+    'import_dir': os.path.join(os.path.dirname(os.path.abspath(__file__)), 'minic_lib'),
+    'module_cache': private_dir('minic_modules'),
+}
+
+# Execution traces recorded by /trace, named after a hash of the program, so
+# the UI can page through the steps of a run without executing it again
+TRACE_DIR = os.path.join(tempfile.gettempdir(), 'minic_traces')
+TRACE_LIMIT = 8 << 20  # bytes kept per trace; a long run keeps its last steps
+TRACE_PAGE = 200
+# Traces unread for TRACE_TTL seconds are deleted, and the oldest go first
+# once the directory would exceed TRACE_DIR_LIMIT bytes
+TRACE_TTL = 60 * 60
+TRACE_DIR_LIMIT = 256 << 20
+
+
+def backend_args():
+    return (['--%s=%d' % (name.replace('_', '-'), value) for name, value in RUN_LIMITS.items()]
+            + ['--%s=%s' % (name.replace('_', '-'), value) for name, value in MODULE_OPTIONS.items()])
+
+
+def read_trace(path, start, count):
+    if minic_native is not None:
+        return minic_native.read_trace(path, start=start, count=count)
+    proc = subprocess.run([BACKEND_EXE, '--read-trace=' + path, '--from=%d' % start, '--count=%d' % count],
+                          stdout=subprocess.PIPE, stderr=subprocess.PIPE, check=True, timeout=BACKEND_TIMEOUT)
+    return json.loads(proc.stdout.decode('utf-8'))
+
+
+def evict_traces():
+    """Make room in TRACE_DIR for one more trace"""
+    traces = []
+    for entry in os.scandir(TRACE_DIR):
+        try:
+            if entry.name.endswith('.trace'):
+                st = entry.stat()
+                traces.append((st.st_mtime, st.st_size, entry.path))
+        except OSError:
+            pass  # removed by a concurrent request
+    traces.sort()
+    expired = time.time() - TRACE_TTL
+    total = sum(size for _, size, _ in traces)
+    for mtime, size, path in traces:
+        if mtime >= expired and total + TRACE_LIMIT <= TRACE_DIR_LIMIT:
+            break
+        try:
+            os.remove(path)
+        except OSError:
+            pass
+        total -= size
+
 @app.route('/')
 def index():
     return render_template('index.html')
@@ -23,11 +120,16 @@ def compile_code():
                 'error': 'No code provided'
             })
 
+        # In-process backend: no pipe I/O or JSON round trip, and the GIL is
+        # released during compilation so requests can run in parallel
+        if minic_native is not None:
+            return jsonify(minic_native.compile(code, **RUN_LIMITS, **MODULE_OPTIONS))
+
         # If C++ backend executable exists, call it via subprocess
-        exe_path = r'backend_cpp\\minic_backend.exe'
         try:
             # Run the C++ backend, send code via stdin, expect JSON on stdout
-            proc = subprocess.run([exe_path], input=code.encode('utf-8'), stdout=subprocess.PIPE, stderr=subprocess.PIPE, check=True)
+            proc = subprocess.run([BACKEND_EXE] + backend_args(), input=code.encode('utf-8'), stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                                  check=True, timeout=BACKEND_TIMEOUT)
             out = proc.stdout.decode('utf-8')
             # Attempt to parse JSON
             result = json.loads(out)
@@ -37,6 +139,12 @@ def compile_code():
             compiler = MiniCCompiler()
             result = compiler.compile(code)
             return jsonify(result)
+        except subprocess.TimeoutExpired:
+            return jsonify({
+                'success': False,
+                'error': 'C++ backend timed out',
+                'details': 'No result within %d seconds' % BACKEND_TIMEOUT
+            })
         except subprocess.CalledProcessError as e:
             # If C++ process failed, return error and stderr
             stderr = e.stderr.decode('utf-8') if hasattr(e, 'stderr') and e.stderr else str(e)
@@ -58,5 +166,58 @@ def compile_code():
             'error': str(e)
         })
 
+@app.route('/trace', methods=['POST'])
+def trace_code():
+    """Run a program with an execution trace; returns its diagnostics and
+    output, a trace_id for /trace/<trace_id> and the first page of steps"""
+    try:
+        code = request.json.get('code', '')
+        if not code.strip():
+            return jsonify({
+                'success': False,
+                'error': 'No code provided'
+            })
+
+        os.makedirs(TRACE_DIR, exist_ok=True)
+        evict_traces()
+        trace_id = hashlib.sha256(code.encode('utf-8')).hexdigest()[:32]
+        path = os.path.join(TRACE_DIR, trace_id + '.trace')
+        if minic_native is not None:
+            result = minic_native.compile(code, emit='diagnostics,output', trace=path, trace_limit=TRACE_LIMIT, **RUN_LIMITS, **MODULE_OPTIONS)
+        else:
+            proc = subprocess.run([BACKEND_EXE, '--emit=diagnostics,output', '--trace=' + path, '--trace-limit=%d' % TRACE_LIMIT] + backend_args(),
+                                  input=code.encode('utf-8'), stdout=subprocess.PIPE, stderr=subprocess.PIPE, check=True, timeout=BACKEND_TIMEOUT)
+            result = json.loads(proc.stdout.decode('utf-8'))
+        # missing only if it could not be written (reported in errors)
+        if os.path.exists(path):
+            result['trace_id'] = trace_id
+            result['trace'] = read_trace(path, 0, TRACE_PAGE)
+        return jsonify(result)
+    except Exception as e:
+        return jsonify({
+            'success': False,
+            'error': str(e)
+        })
+
+@app.route('/trace/<trace_id>')
+def trace_steps(trace_id):
+    """Steps ?start=N&count=M of a trace recorded by /trace"""
+    path = os.path.join(TRACE_DIR, trace_id + '.trace')
+    if not re.fullmatch(r'[0-9a-f]{32}', trace_id) or not os.path.exists(path):
+        return jsonify({
+            'success': False,
+            'error': 'Unknown trace'
+        }), 404
+    start = max(request.args.get('start', 0, type=int), 0)
+    count = min(max(request.args.get('count', TRACE_PAGE, type=int), 0), 10 * TRACE_PAGE)
+    try:
+        os.utime(path)  # still in use; keep it from expiring
+        return jsonify(read_trace(path, start, count))
+    except Exception as e:
+        return jsonify({
+            'success': False,
+            'error': str(e)
+        })
+
 if __name__ == '__main__':
     app.run(debug=True, host='0.0.0.0', port=5000)
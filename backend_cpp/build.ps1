@@ -19,4 +19,10 @@ if (Test-Path $exe) {
     Write-Host "Build completed but exe not found at $exe"
 }
 
+$module = Get-ChildItem "build\$BuildType" -Filter "minic_native*.pyd" -ErrorAction SilentlyContinue | Select-Object -First 1
+if ($module) {
+    Copy-Item $module.FullName -Destination "." -Force
+    Write-Host "Copied $($module.Name) for in-process use by app.py"
+}
+
 Pop-Location
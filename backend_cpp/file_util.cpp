@@ -0,0 +1,23 @@
+#include "file_util.h"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+using namespace std;
+
+bool write_file_atomic(const string &path, const string &bytes, string &err) {
+    string tmp = path + ".tmp" + to_string(hash<thread::id>()(this_thread::get_id()) ^ (size_t)chrono::steady_clock::now().time_since_epoch().count());
+    {
+        ofstream out(tmp, ios::binary | ios::trunc);
+        if (!out) { err = "cannot open '" + path + "' for writing"; return false; }
+        out.write(bytes.data(), (streamsize)bytes.size());
+        if (!out) { out.close(); remove(tmp.c_str()); err = "write to '" + path + "' failed"; return false; }
+    }
+    error_code ec;
+    filesystem::rename(tmp, path, ec);
+    if (ec) { remove(tmp.c_str()); err = "cannot replace '" + path + "': " + ec.message(); return false; }
+    return true;
+}
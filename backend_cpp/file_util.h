@@ -0,0 +1,10 @@
+// File helpers shared by snapshots and execution traces. Internal to
+// minic_core.
+#pragma once
+
+#include <string>
+
+// Writes bytes to a private temporary file beside path and renames it into
+// place, so a concurrent reader never sees a partial file. On failure err is
+// set and path is left as it was.
+bool write_file_atomic(const std::string &path, const std::string &bytes, std::string &err);
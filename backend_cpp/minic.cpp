@@ -0,0 +1,2489 @@
+#include "minic.h"
+#include "simd_kernels.h"
+#include "snapshot.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+using namespace std;
+
+
+vector<Token> tokenize(const string &code, vector<string> &errors) {
+    vector<Token> tokens;
+    int i = 0, n = (int)code.size();
+    int line = 1;
+    while (i < n) {
+        char c = code[i];
+        if (c == '\n') { ++line; ++i; continue; }
+        if (isspace((unsigned char)c)) { ++i; continue; }
+        if (c == '/' && i+1 < n && code[i+1] == '/') {
+            while (i < n && code[i] != '\n') ++i;
+            continue;
+        }
+        auto match_op = [&](const string &op)->bool{
+            if (i + (int)op.size() <= n && code.substr(i, op.size()) == op) {
+                tokens.push_back({op, op, line, i}); i += (int)op.size(); return true;
+            }
+            return false;
+        };
+        vector<string> ops = {"==","!=","<=",">=","&&","||","+","-","*","/","(",")","{","}","[","]",";",":",",","=","<",">","!"};
+        bool did = false;
+        for (auto &op: ops) { if (match_op(op)) { did = true; break; } }
+        if (did) continue;
+        if (c == '"' && !tokens.empty() && tokens.back().type=="IDENTIFIER" && tokens.back().text=="import") {
+            // import path; the only string literal, so anywhere else '"' is
+            // an illegal character. No escapes, may not span lines
+            int j = i + 1; while (j < n && code[j] != '"' && code[j] != '\n') ++j;
+            if (j >= n || code[j] != '"') { errors.push_back("Unterminated string at line " + to_string(line)); i = j; continue; }
+            tokens.push_back({"STRING", code.substr(i+1, j-i-1), line, i});
+            i = j + 1; continue;
+        }
+        if (isdigit((unsigned char)c)) {
+            int j = i; bool has_dot = false;
+            while (j < n && (isdigit((unsigned char)code[j]) || code[j]=='.')) { if (code[j]=='.') has_dot = true; ++j; }
+            string num = code.substr(i, j-i);
+            tokens.push_back({ has_dot? string("FLOATNUM") : string("NUMBER"), num, line, i });
+            i = j; continue;
+        }
+        if (isalpha((unsigned char)c) || c == '_') {
+            int j = i; while (j < n && (isalnum((unsigned char)code[j]) || code[j]=='_')) ++j;
+            string id = code.substr(i, j-i);
+            static unordered_map<string,string> reserved = {
+                {"if","IF"},{"else","ELSE"},{"while","WHILE"},{"for","FOR"},
+                {"return","RETURN"},{"func","FUNC"},{"var","VAR"},
+                {"int","INT"},{"float","FLOAT"},{"bool","BOOL"},
+                {"true","TRUE"},{"false","FALSE"},{"print","PRINT"}
+            };
+            auto it = reserved.find(id);
+            if (it != reserved.end()) tokens.push_back({it->second, id, line, i});
+            else tokens.push_back({"IDENTIFIER", id, line, i});
+            i = j; continue;
+        }
+        string bad(1,c);
+        errors.push_back("Illegal character '" + bad + "' at line " + to_string(line));
+        ++i;
+    }
+    return tokens;
+}
+
+string escape_json(const string &s) {
+    string out;
+    for (char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default: out += c; break;
+        }
+    }
+    return out;
+}
+
+string ast_to_json(const shared_ptr<AST> &node, int indent) {
+    if (!node) return "null";
+    string pad(indent, ' ');
+    ostringstream ss;
+    ss << "{\n" << pad << "  \"type\": \"" << node->node_type << "\"";
+    if (!node->value.empty()) ss << ",\n" << pad << "  \"value\": \"" << escape_json(node->value) << "\"";
+    if (!node->children.empty()) {
+        ss << ",\n" << pad << "  \"children\": [\n";
+        for (size_t i=0;i<node->children.size();++i) {
+            ss << pad << "    " << ast_to_json(node->children[i], indent+4);
+            if (i+1<node->children.size()) ss << ",\n"; else ss << "\n";
+        }
+        ss << pad << "  ]\n" << pad << "}";
+    } else {
+        ss << "\n" << pad << "}";
+    }
+    return ss.str();
+}
+
+// Children are released iteratively: an operator chain like 1+1+...+1 is as
+// deep as it is long, too deep to destroy recursively
+AST::~AST() {
+    vector<shared_ptr<AST>> pending;
+    for (auto &c : children) if (c) pending.push_back(move(c));
+    while (!pending.empty()) {
+        shared_ptr<AST> n = move(pending.back()); pending.pop_back();
+        if (n.use_count() == 1) for (auto &c : n->children) if (c) pending.push_back(move(c));
+    }
+}
+
+// Edges on the longest root-to-leaf path, measured without recursion
+static int ast_depth(const AST &root) {
+    int deepest = 0;
+    vector<pair<const AST*, int>> stack{{&root, 0}};
+    while (!stack.empty()) {
+        auto [n, d] = stack.back(); stack.pop_back();
+        deepest = max(deepest, d);
+        for (auto &c : n->children) if (c) stack.push_back({c.get(), d + 1});
+    }
+    return deepest;
+}
+
+struct Parser {
+    vector<Token> toks;
+    int idx = 0;
+    vector<string> errors;
+    // Statements and operands the descent is nested in. Past MAX_AST_DEPTH the
+    // program is rejected before the parser runs off the end of the stack.
+    int depth = 0;
+    struct TooDeep {};
+    struct Descend {
+        Parser &p;
+        explicit Descend(Parser &q): p(q) { if (++p.depth > MAX_AST_DEPTH) { --p.depth; throw TooDeep(); } }
+        ~Descend() { --p.depth; }
+    };
+    Parser(vector<Token> t): toks(move(t)), idx(0) {}
+    Token peek(int offset=0) { if (idx+offset < (int)toks.size()) return toks[idx+offset]; return {"","",-1,-1}; }
+    bool match(const string &type) { if (idx < (int)toks.size() && toks[idx].type==type) { ++idx; return true; } return false; }
+    bool expect(const string &type, const string &msg) { if (match(type)) return true; errors.push_back(msg + "; found '" + (idx<(int)toks.size()?toks[idx].text:"EOF") + "'"); return false; }
+
+    shared_ptr<AST> parse_program() {
+        auto prog = make_shared<AST>("Program");
+        bool deep = false;
+        try {
+            while (idx < (int)toks.size()) {
+                if (peek().type=="IDENTIFIER" && peek().text=="import" && peek(1).type=="STRING") {
+                    // import "file.minic";  (top level only; "import" stays a valid identifier)
+                    match("IDENTIFIER"); match("STRING");
+                    auto node = make_shared<AST>("Import"); node->value = toks[idx-1].text;
+                    if (!expect(";","Expected ';' after import")) break;
+                    prog->children.push_back(node);
+                    continue;
+                }
+                auto s = parse_statement();
+                if (s) prog->children.push_back(s);
+                else break;
+            }
+        } catch (TooDeep &) { deep = true; }
+        // operator chains are built in a loop, so only the finished tree shows
+        // how deep they went; nothing after this walks a tree that is too deep
+        if (deep || ast_depth(*prog) > MAX_AST_DEPTH) {
+            errors.push_back("Program nested deeper than " + to_string(MAX_AST_DEPTH) + " levels");
+            prog->children.clear();
+        }
+        return prog;
+    }
+
+    // Statements remember where they start, for execution traces
+    shared_ptr<AST> parse_statement() {
+        Descend nested(*this);
+        Token start = peek();
+        auto node = parse_statement_body();
+        if (node) { node->line = start.line; node->pos = start.pos; }
+        return node;
+    }
+
+    shared_ptr<AST> parse_statement_body() {
+        if (match("VAR")) {
+            if (!expect("IDENTIFIER","Expected identifier after 'var'")) return nullptr;
+            string name = toks[idx-1].text;
+            if (!expect(":","Expected ':' after identifier in var declaration")) return nullptr;
+            string type;
+            if (match("INT")) type = "int";
+            else if (match("FLOAT")) type = "float";
+            else if (match("BOOL")) type = "bool";
+            else { errors.push_back("Unknown type in var declaration"); return nullptr; }
+            auto tnode = make_shared<AST>(type);
+            if (match("[")) {
+                // fixed-size array: the type node becomes "<elem>[]" carrying the length
+                if (!expect("NUMBER","Expected array length after '['")) return nullptr;
+                string len = toks[idx-1].text;
+                if (!expect("]","Expected ']' after array length")) return nullptr;
+                if (type=="bool") { errors.push_back("Arrays of bool are not supported"); return nullptr; }
+                tnode = make_shared<AST>(type + "[]"); tnode->value = len;
+            }
+            auto node = make_shared<AST>("VarDecl"); node->value = name; node->children.push_back(tnode);
+            if (match("=")) {
+                auto expr = parse_expression(); if (!expr) return nullptr; node->children.push_back(expr);
+            }
+            if (!expect(";","Expected ';' after var declaration")) return nullptr;
+            return node;
+        }
+        if (match("FUNC")) {
+            if (!expect("IDENTIFIER","Expected function name after 'func'")) return nullptr;
+            string fname = toks[idx-1].text;
+            if (!expect("(","Expected '(' after function name")) return nullptr;
+            auto params = make_shared<AST>("Params");
+            if (!match(")")) {
+                while (true) {
+                    if (!expect("IDENTIFIER","Expected parameter name")) return nullptr;
+                    string pname = toks[idx-1].text;
+                    if (!expect(":","Expected ':' after parameter name")) return nullptr;
+                    string ptype;
+                    if (match("INT")) ptype = "int";
+                    else if (match("FLOAT")) ptype = "float";
+                    else if (match("BOOL")) ptype = "bool";
+                    else { errors.push_back("Unknown parameter type"); return nullptr; }
+                    auto pn = make_shared<AST>("Param"); pn->value = pname; pn->children.push_back(make_shared<AST>(ptype));
+                    params->children.push_back(pn);
+                    if (match(")")) break;
+                    if (!expect(",","Expected ',' between parameters")) return nullptr;
+                }
+            }
+            if (!expect(":","Expected ':' after parameter list")) return nullptr;
+            string rettype;
+            if (match("INT")) rettype = "int";
+            else if (match("FLOAT")) rettype = "float";
+            else if (match("BOOL")) rettype = "bool";
+            else { errors.push_back("Unknown return type"); return nullptr; }
+            if (!expect("{","Expected '{' to start function body")) return nullptr;
+            auto body = make_shared<AST>("Block");
+            while (!match("}")) {
+                if (idx >= (int)toks.size()) { errors.push_back("Unterminated function body"); return nullptr; }
+                auto s = parse_statement(); if (s) body->children.push_back(s); else return nullptr;
+            }
+            auto node = make_shared<AST>("FunctionDecl"); node->value = fname; node->children.push_back(params); node->children.push_back(make_shared<AST>(rettype)); node->children.push_back(body);
+            return node;
+        }
+        if (match("IF")) {
+            if (!expect("(","Expected '(' after 'if'")) return nullptr;
+            auto cond = parse_expression(); if (!cond) return nullptr;
+            if (!expect(")","Expected ')' after condition")) return nullptr;
+            if (!expect("{","Expected '{' to start if block")) return nullptr;
+            auto thenb = make_shared<AST>("Block");
+            while (!match("}")) { if (idx>= (int)toks.size()) { errors.push_back("Unterminated if block"); return nullptr;} auto s = parse_statement(); if (s) thenb->children.push_back(s); else return nullptr; }
+            shared_ptr<AST> elseb = nullptr;
+            if (match("ELSE")) {
+                if (!expect("{","Expected '{' to start else block")) return nullptr;
+                elseb = make_shared<AST>("Block");
+                while (!match("}")) { if (idx>= (int)toks.size()) { errors.push_back("Unterminated else block"); return nullptr;} auto s = parse_statement(); if (s) elseb->children.push_back(s); else return nullptr; }
+            }
+            auto node = make_shared<AST>("If"); node->children.push_back(cond); node->children.push_back(thenb); if (elseb) node->children.push_back(elseb); return node;
+        }
+        if (match("WHILE")) {
+            if (!expect("(","Expected '(' after 'while'")) return nullptr;
+            auto cond = parse_expression(); if (!cond) return nullptr;
+            if (!expect(")","Expected ')' after condition")) return nullptr;
+            if (!expect("{","Expected '{' to start while body")) return nullptr;
+            auto body = make_shared<AST>("Block");
+            while (!match("}")) { if (idx>= (int)toks.size()) { errors.push_back("Unterminated while block"); return nullptr;} auto s = parse_statement(); if (s) body->children.push_back(s); else return nullptr; }
+            auto node = make_shared<AST>("While"); node->children.push_back(cond); node->children.push_back(body); return node;
+        }
+        if (peek().type=="IDENTIFIER" && peek().text=="parallel" && peek(1).type=="FOR") {
+            // parallel for (init; cond; post) [reduce(op: var)] { body }
+            // "parallel" and "reduce" are only special here, so they stay valid identifiers
+            match("IDENTIFIER"); match("FOR");
+            auto loop = parse_for_header("parallel for"); if (!loop) return nullptr;
+            if (loop->children.size()!=3) { errors.push_back("parallel for needs an init, a condition and a step"); return nullptr; }
+            loop->node_type = "ParallelFor";
+            if (peek().type=="IDENTIFIER" && peek().text=="reduce" && peek(1).type=="(") {
+                match("IDENTIFIER"); match("(");
+                string op = peek().text;
+                if (!match("+") && !match("*")) { errors.push_back("Expected '+' or '*' in reduce clause; found '" + (idx<(int)toks.size()?toks[idx].text:"EOF") + "'"); return nullptr; }
+                if (!expect(":","Expected ':' after reduction operator")) return nullptr;
+                if (!expect("IDENTIFIER","Expected reduction variable")) return nullptr;
+                auto var = make_shared<AST>("Identifier"); var->value = toks[idx-1].text;
+                if (!expect(")","Expected ')' after reduce clause")) return nullptr;
+                auto red = make_shared<AST>("Reduction"); red->value = op; red->children.push_back(var);
+                loop->children.push_back(red);
+            }
+            if (!parse_for_body(loop)) return nullptr;
+            return loop;
+        }
+        if (match("FOR")) {
+            auto node = parse_for_header("for"); if (!node) return nullptr;
+            if (!parse_for_body(node)) return nullptr;
+            return node;
+        }
+        if (match("RETURN")) {
+            auto node = make_shared<AST>("Return");
+            if (!match(";")) { auto e = parse_expression(); if (!e) return nullptr; node->children.push_back(e); if (!expect(";","Expected ';' after return")) return nullptr; }
+            return node;
+        }
+        if (match("PRINT")) {
+            if (match("(")) {
+                auto e = parse_expression(); if (!e) return nullptr; if (!expect(")","Expected ')' after print argument")) return nullptr; if (!expect(";","Expected ';' after print")) return nullptr; auto node = make_shared<AST>("Print"); node->children.push_back(e); return node;
+            } else {
+                auto e = parse_expression(); if (!e) return nullptr; if (!expect(";","Expected ';' after print")) return nullptr; auto node = make_shared<AST>("Print"); node->children.push_back(e); return node;
+            }
+        }
+        if (peek().type=="IDENTIFIER" && peek(1).type=="=") {
+            string name = peek().text; match("IDENTIFIER"); match("="); auto e = parse_expression(); if (!expect(";","Expected ';' after assignment")) return nullptr; auto node = make_shared<AST>("Assign"); node->value = name; node->children.push_back(e); return node;
+        }
+        auto expr = parse_expression();
+        if (expr && expr->node_type=="Index" && match("=")) {
+            auto e = parse_expression(); if (!e) return nullptr; if (!expect(";","Expected ';' after assignment")) return nullptr;
+            auto node = make_shared<AST>("IndexAssign"); node->value = expr->value; node->children.push_back(expr->children[0]); node->children.push_back(e); return node;
+        }
+        if (expr) { if (!expect(";","Expected ';' after expression")) return nullptr; return expr; }
+        return nullptr;
+    }
+
+    // "(init?; cond?; post?)" after 'for'; returns a node holding the parts present
+    shared_ptr<AST> parse_for_header(const string &what) {
+        if (!expect("(","Expected '(' after '" + what + "'")) return nullptr;
+        shared_ptr<AST> init=nullptr, cond=nullptr, post=nullptr;
+        if (!match(";")) {
+            if (peek().type=="VAR") init = parse_statement();
+            else {
+                auto a = parse_expression(); init = a; if (!expect(";","Expected ';' after for init")) return nullptr;
+            }
+        }
+        if (!match(";")) {
+            cond = parse_expression(); if (!expect(";","Expected ';' after for condition")) return nullptr;
+        }
+        if (!match(")")) {
+            if (peek().type=="IDENTIFIER" && peek(1).type=="=") {
+                string name = peek().text; match("IDENTIFIER"); match("=");
+                auto e = parse_expression(); if (!e) return nullptr;
+                post = make_shared<AST>("Assign"); post->value = name; post->children.push_back(e);
+            }
+            else post = parse_expression();
+            if (!expect(")","Expected ')' after for post")) return nullptr;
+        }
+        auto node = make_shared<AST>("For"); if (init) node->children.push_back(init); if (cond) node->children.push_back(cond); if (post) node->children.push_back(post);
+        return node;
+    }
+
+    // "{ ... }" of a loop, appended as the node's last child
+    bool parse_for_body(const shared_ptr<AST> &node) {
+        if (!expect("{","Expected '{' to start for body")) return false;
+        auto body = make_shared<AST>("Block");
+        while (!match("}")) { if (idx>= (int)toks.size()) { errors.push_back("Unterminated for block"); return false;} auto s = parse_statement(); if (s) body->children.push_back(s); else return false; }
+        node->children.push_back(body);
+        return true;
+    }
+
+    shared_ptr<AST> parse_expression() { return parse_or(); }
+    shared_ptr<AST> parse_or() {
+        auto left = parse_and();
+        while (match("||")) {
+            auto right = parse_and(); auto node = make_shared<AST>("BinaryOp"); node->value = "||"; node->children.push_back(left); node->children.push_back(right); left = node;
+        }
+        return left;
+    }
+    shared_ptr<AST> parse_and() {
+        auto left = parse_eq();
+        while (match("&&")) {
+            auto right = parse_eq(); auto node = make_shared<AST>("BinaryOp"); node->value = "&&"; node->children.push_back(left); node->children.push_back(right); left = node;
+        }
+        return left;
+    }
+    shared_ptr<AST> parse_eq() {
+        auto left = parse_rel();
+        while (true) {
+            if (match("==")) { auto right = parse_rel(); auto node = make_shared<AST>("BinaryOp"); node->value = "=="; node->children.push_back(left); node->children.push_back(right); left = node; }
+            else if (match("!=")) { auto right = parse_rel(); auto node = make_shared<AST>("BinaryOp"); node->value = "!="; node->children.push_back(left); node->children.push_back(right); left = node; }
+            else break;
+        }
+        return left;
+    }
+    shared_ptr<AST> parse_rel() {
+        auto left = parse_add();
+        while (true) {
+            if (match("<")) { auto right = parse_add(); auto node = make_shared<AST>("BinaryOp"); node->value = "<"; node->children.push_back(left); node->children.push_back(right); left = node; }
+            else if (match(">")) { auto right = parse_add(); auto node = make_shared<AST>("BinaryOp"); node->value = ">"; node->children.push_back(left); node->children.push_back(right); left = node; }
+            else if (match("<=")) { auto right = parse_add(); auto node = make_shared<AST>("BinaryOp"); node->value = "<="; node->children.push_back(left); node->children.push_back(right); left = node; }
+            else if (match(">=")) { auto right = parse_add(); auto node = make_shared<AST>("BinaryOp"); node->value = ">="; node->children.push_back(left); node->children.push_back(right); left = node; }
+            else break;
+        }
+        return left;
+    }
+    shared_ptr<AST> parse_add() {
+        auto left = parse_mul();
+        while (true) {
+            if (match("+")) { auto right = parse_mul(); auto node = make_shared<AST>("BinaryOp"); node->value = "+"; node->children.push_back(left); node->children.push_back(right); left = node; }
+            else if (match("-")) { auto right = parse_mul(); auto node = make_shared<AST>("BinaryOp"); node->value = "-"; node->children.push_back(left); node->children.push_back(right); left = node; }
+            else break;
+        }
+        return left;
+    }
+    shared_ptr<AST> parse_mul() {
+        auto left = parse_unary();
+        while (true) {
+            if (match("*")) { auto right = parse_unary(); auto node = make_shared<AST>("BinaryOp"); node->value = "*"; node->children.push_back(left); node->children.push_back(right); left = node; }
+            else if (match("/")) { auto right = parse_unary(); auto node = make_shared<AST>("BinaryOp"); node->value = "/"; node->children.push_back(left); node->children.push_back(right); left = node; }
+            else break;
+        }
+        return left;
+    }
+    shared_ptr<AST> parse_unary() {
+        Descend nested(*this);
+        if (match("!")) { auto v = parse_unary(); auto node = make_shared<AST>("UnaryOp"); node->value = "!"; node->children.push_back(v); return node; }
+        if (match("-")) { auto v = parse_unary(); auto node = make_shared<AST>("UnaryOp"); node->value = "-"; node->children.push_back(v); return node; }
+        return parse_primary();
+    }
+    shared_ptr<AST> parse_primary() {
+        if (match("NUMBER")) { auto node = make_shared<AST>("Literal"); node->value = toks[idx-1].text; return node; }
+        if (match("FLOATNUM")) { auto node = make_shared<AST>("Literal"); node->value = toks[idx-1].text; return node; }
+        if (match("TRUE")) { auto node = make_shared<AST>("Literal"); node->value = "true"; return node; }
+        if (match("FALSE")) { auto node = make_shared<AST>("Literal"); node->value = "false"; return node; }
+        if (match("IDENTIFIER")) {
+            const Token &tok = toks[idx-1]; string name = tok.text;
+            if (match("(")) {
+                auto call = make_shared<AST>("Call"); call->value = name; call->line = tok.line; call->pos = tok.pos;
+                if (!match(")")) {
+                    while (true) {
+                        auto arg = parse_expression(); if (!arg) return nullptr; call->children.push_back(arg);
+                        if (match(")")) break;
+                        if (!expect(",","Expected ',' between call arguments")) return nullptr;
+                    }
+                }
+                return call;
+            }
+            if (match("[")) {
+                auto index = parse_expression(); if (!index) return nullptr;
+                if (!expect("]","Expected ']' after array index")) return nullptr;
+                auto node = make_shared<AST>("Index"); node->value = name; node->children.push_back(index); return node;
+            }
+            auto node = make_shared<AST>("Identifier"); node->value = name; return node;
+        }
+        if (match("(")) { auto e = parse_expression(); if (!expect(")","Expected ')'")) return nullptr; return e; }
+        return nullptr;
+    }
+};
+
+string Value::toString() const {
+    ostringstream ss;
+    if (type==INT) ss<<i;
+    else if (type==FLOAT) {
+        // format with removal of trailing zeros
+        ss<<f;
+    }
+    else if (type==BOOL) ss<<(b?"true":"false");
+    else if (is_array()) {
+        ss<<"[";
+        for (size_t k=0;k<length();++k) {
+            if (k) ss<<", ";
+            if (type==INT_ARRAY) ss<<arr->ints[k]; else ss<<arr->floats[k];
+        }
+        ss<<"]";
+    }
+    return ss.str();
+}
+
+// Names used by one semantic-analysis run. Every identifier is interned once
+// (AST::sym holds the id) so the analyzer's scope, global and function
+// lookups are plain array indexing instead of string hashing. The
+// interpreter does not use the ids; it still resolves names by string.
+struct ResolvedNames {
+    unordered_map<string, int> ids;
+    vector<string> names;
+    vector<Value::Type> global_types;            // NONE when not a global
+    vector<long long> global_lengths;            // declared length of global arrays; -1 if redeclared
+    vector<const FunctionInfo*> function_infos;  // nullptr when not a function
+    bool has_parallel = false;                   // program contains a parallel for
+
+    // Globals each function reads and writes, directly or through its callees
+    // (indexed by function sym; only built when has_parallel). A local hides a
+    // global of the same name only within its block, as at run time.
+    struct Effects { set<int> reads, writes; };
+    vector<Effects> effects;
+
+    int intern(const string &s) {
+        auto it = ids.find(s);
+        if (it != ids.end()) return it->second;
+        int id = (int)names.size();
+        ids.emplace(s, id); names.push_back(s);
+        return id;
+    }
+
+    void resolve(const shared_ptr<AST> &node) {
+        if (!node) return;
+        const string &t = node->node_type;
+        if (t=="Identifier" || t=="Assign" || t=="VarDecl" || t=="Call" || t=="Param" || t=="FunctionDecl" || t=="Index" || t=="IndexAssign") node->sym = intern(node->value);
+        else if (t=="ParallelFor") has_parallel = true;
+        for (auto &c : node->children) resolve(c);
+    }
+
+    void compute_effects() {
+        effects.assign(names.size(), Effects());
+        vector<pair<int, set<int>>> calls;
+        for (int f=0;f<(int)names.size();++f) {
+            const FunctionInfo *fi = function_infos[f];
+            // imported functions were checked in a module, which has no globals
+            if (!fi || !fi->module.empty()) continue;
+            Locals locals;
+            for (auto &p : fi->params) locals.declare(ids.at(p.first));
+            calls.push_back({f, {}});
+            collect_effects(fi->body, locals, effects[f], calls.back().second);
+        }
+        // propagate through calls until nothing changes (handles recursion)
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (auto &c : calls) {
+                Effects &e = effects[c.first];
+                size_t before = e.reads.size() + e.writes.size();
+                for (int g : c.second) {
+                    e.reads.insert(effects[g].reads.begin(), effects[g].reads.end());
+                    e.writes.insert(effects[g].writes.begin(), effects[g].writes.end());
+                }
+                if (e.reads.size() + e.writes.size() != before) changed = true;
+            }
+        }
+    }
+
+private:
+    // Locals in scope at a point of a function body
+    struct Locals {
+        unordered_map<int, int> live;  // sym -> declarations in scope
+        vector<int> declared;          // in declaration order
+        void declare(int sym) { ++live[sym]; declared.push_back(sym); }
+        void pop_to(size_t mark) {
+            while (declared.size() > mark) { if (--live[declared.back()]==0) live.erase(declared.back()); declared.pop_back(); }
+        }
+        bool has(int sym) const { return live.count(sym) != 0; }
+    };
+
+    void collect_effects(const shared_ptr<AST> &node, Locals &locals, Effects &e, set<int> &callees) const {
+        if (!node) return;
+        const string &t = node->node_type;
+        // a loop's init variable is scoped to the loop, like a block's locals
+        size_t mark = locals.declared.size();
+        auto global = [&](int sym) { return !locals.has(sym) && global_types[sym]!=Value::NONE; };
+        if ((t=="Identifier" || t=="Index") && global(node->sym)) e.reads.insert(node->sym);
+        else if ((t=="Assign" || t=="IndexAssign") && global(node->sym)) e.writes.insert(node->sym);
+        else if (t=="Call") {
+            if (function_infos[node->sym]) callees.insert(node->sym);
+            else if (node->value=="fill" && !node->children.empty() && node->children[0]->node_type=="Identifier" && global(node->children[0]->sym)) e.writes.insert(node->children[0]->sym);
+        }
+        for (auto &c : node->children) collect_effects(c, locals, e, callees);
+        // the initializer is evaluated before the name comes into scope
+        if (t=="VarDecl") locals.declare(node->sym);
+        else if (t=="Block" || t=="For" || t=="ParallelFor") locals.pop_to(mark);
+    }
+};
+
+// Block-structured symbol table over interned ids: one binding slot per
+// symbol plus an undo log, so entering a scope is O(1) and leaving it only
+// touches the names that scope declared.
+struct ScopeStack {
+    struct Binding { Value::Type type = Value::NONE; int depth = -1; long long length = 0; };
+    struct Undo { int sym; Binding prev; };
+    vector<Binding> current;
+    vector<Undo> log;
+    vector<size_t> marks;
+
+    void reset(size_t symbol_count) { current.assign(symbol_count, Binding()); log.clear(); marks.clear(); }
+    int depth() const { return (int)marks.size(); }
+    void push() { marks.push_back(log.size()); }
+    void pop() {
+        size_t mark = marks.back(); marks.pop_back();
+        while (log.size() > mark) { current[log.back().sym] = log.back().prev; log.pop_back(); }
+    }
+    const Binding *lookup(int sym) const { return current[sym].depth >= 0 ? &current[sym] : nullptr; }
+    bool declared_in_current(int sym) const { return current[sym].depth == depth(); }
+    void declare(int sym, Value::Type t, long long length = 0) { log.push_back({sym, current[sym]}); current[sym] = {t, depth(), length}; }
+};
+
+// Semantic analyzer: performs a static AST walk and emits errors/warnings
+class SemanticAnalyzer {
+public:
+    shared_ptr<AST> ast;
+    // Reference to the interpreter's symbol/function tables collected earlier
+    const unordered_map<string, Value::Type> &globals;
+    const unordered_map<string, FunctionInfo>* functions = nullptr;
+    // Threads used to analyze function bodies (0 = all available)
+    unsigned jobs = 1;
+
+    vector<string> errors;
+    vector<string> warnings;
+
+    // Below this many functions the thread pool costs more than it saves.
+    static const size_t PARALLEL_MIN_FUNCTIONS = 64;
+
+    SemanticAnalyzer(const shared_ptr<AST> &a, const unordered_map<string, Value::Type> &g, const unordered_map<string, FunctionInfo> &f, unsigned j = 1)
+        : ast(a), globals(g), functions(&f), jobs(j) {}
+
+    static Value::Type literal_type(const string &s) {
+        if (s=="true"||s=="false") return Value::BOOL;
+        if (s.find('.')!=string::npos) return Value::FLOAT;
+        return Value::INT;
+    }
+    static string type_to_string(Value::Type t) { return type_name(t); }
+    static bool compatible(Value::Type expected, Value::Type actual) {
+        if (expected==Value::NONE || actual==Value::NONE) return false;
+        if (expected==actual) return true;
+        // allow implicit int -> float promotion
+        if (expected==Value::FLOAT && actual==Value::INT) return true;
+        return false;
+    }
+
+    Value::Type string_to_type(const string &s) const {
+        if (s=="int") return Value::INT;
+        if (s=="float") return Value::FLOAT;
+        if (s=="bool") return Value::BOOL;
+        if (s=="int[]") return Value::INT_ARRAY;
+        if (s=="float[]") return Value::FLOAT_ARRAY;
+        return Value::NONE;
+    }
+
+    static bool is_array_type(Value::Type t) { return t==Value::INT_ARRAY || t==Value::FLOAT_ARRAY; }
+    static Value::Type element_type(Value::Type t) { return t==Value::INT_ARRAY ? Value::INT : Value::FLOAT; }
+    static bool is_int_literal(const shared_ptr<AST> &n) {
+        return n && n->node_type=="Literal" && n->value!="true" && n->value!="false" && n->value.find('.')==string::npos;
+    }
+    // An int literal short enough for stoll; longer ones are treated as unknown values
+    static bool is_small_int_literal(const shared_ptr<AST> &n) { return is_int_literal(n) && n->value.size() <= 18; }
+
+    // Longest array MiniC will allocate (elements)
+    static const long long MAX_ARRAY_LENGTH = 1LL << 24;
+
+    // Declared length of an array variable, -1 if unknown
+    long long var_length(int sym) const {
+        if (const ScopeStack::Binding *b = scope->lookup(sym)) return is_array_type(b->type) ? b->length : -1;
+        return is_array_type(names->global_types[sym]) ? names->global_lengths[sym] : -1;
+    }
+    // Statically known length of an array-valued expression, -1 if unknown
+    long long static_length(const shared_ptr<AST> &node) const {
+        if (!node) return -1;
+        if (node->node_type=="Identifier") return is_declared(node->sym) ? var_length(node->sym) : -1;
+        if (node->node_type=="BinaryOp") { long long l = static_length(node->children[0]); return l>=0 ? l : static_length(node->children[1]); }
+        return -1;
+    }
+    bool is_array_builtin(const shared_ptr<AST> &call) const {
+        const string &n = call->value;
+        return !names->function_infos[call->sym] && (n=="len" || n=="sum" || n=="dot" || n=="fill");
+    }
+
+    // Type of a name visible from the current scope (innermost local first, then globals)
+    Value::Type lookup_var(int sym) const {
+        if (const ScopeStack::Binding *b = scope->lookup(sym)) return b->type;
+        return names->global_types[sym];
+    }
+    bool is_declared(int sym) const { return scope->lookup(sym) || names->global_types[sym]!=Value::NONE; }
+
+    // Infer expression type in the current scope (params + visible local vars)
+    Value::Type infer_expr_type(const shared_ptr<AST> &node) {
+        if (!node) return Value::NONE;
+        if (node->node_type=="Literal") return literal_type(node->value);
+        if (node->node_type=="Identifier") {
+            if (is_declared(node->sym)) {
+                if (!parallel_loops.empty()) check_parallel_read(node);
+                return lookup_var(node->sym);
+            }
+            errors.push_back("Undefined identifier '" + node->value + "'");
+            return Value::NONE;
+        }
+        if (node->node_type=="Index") return analyze_index(node);
+        if (node->node_type=="Call") {
+            string fname = node->value;
+            if (fname=="print") return Value::NONE; // print returns none
+            if (is_array_builtin(node)) return infer_builtin(node);
+            const FunctionInfo *fip = names->function_infos[node->sym];
+            if (!fip) { errors.push_back("Call to undefined function '" + fname + "'"); return Value::NONE; }
+            if (!parallel_loops.empty()) check_parallel_call(node);
+            auto &fi = *fip;
+            if (node->children.size() != fi.params.size()) {
+                errors.push_back("Argument count mismatch in call to '" + fname + "'");
+            }
+            for (size_t i=0;i<node->children.size() && i<fi.params.size();++i) {
+                Value::Type at = infer_expr_type(node->children[i]);
+                Value::Type pt = string_to_type(fi.params[i].second);
+                if (at==Value::NONE) continue;
+                if (!compatible(pt, at)) {
+                    errors.push_back("Argument " + to_string(i+1) + " type mismatch in call to '" + fname + "': expected " + type_to_string(pt) + ", got " + type_to_string(at));
+                }
+            }
+            return string_to_type(fi.return_type);
+        }
+        if (node->node_type=="BinaryOp") {
+            string op = node->value;
+            Value::Type L = infer_expr_type(node->children[0]);
+            Value::Type R = infer_expr_type(node->children[1]);
+            if (L==Value::NONE || R==Value::NONE) return Value::NONE;
+            if (is_array_type(L) || is_array_type(R)) {
+                // only element-wise + and * between arrays of one element type
+                if ((op=="+"||op=="*") && L==R) {
+                    long long ll = static_length(node->children[0]), rl = static_length(node->children[1]);
+                    if (ll>=0 && rl>=0 && ll!=rl) errors.push_back("Array length mismatch in element-wise '" + op + "': " + to_string(ll) + " vs " + to_string(rl));
+                    return L;
+                }
+                errors.push_back("Invalid operand types for '" + op + "': " + type_to_string(L) + " and " + type_to_string(R));
+                return Value::NONE;
+            }
+            if (op=="+"||op=="-"||op=="*"||op=="/") {
+                // arithmetic: require numeric
+                if ((L==Value::BOOL) || (R==Value::BOOL)) { errors.push_back("Invalid operand type for arithmetic operator '"+op+"'"); return Value::NONE; }
+                if (L==Value::FLOAT || R==Value::FLOAT) return Value::FLOAT; return Value::INT;
+            }
+            if (op=="<"||op==">"||op=="<="||op==">=") {
+                if ((L==Value::BOOL) || (R==Value::BOOL)) { errors.push_back("Invalid operand type for relational operator '"+op+"'"); return Value::NONE; }
+                return Value::BOOL;
+            }
+            if (op=="=="||op=="!=") {
+                // allow comparisons between numeric types or booleans
+                if ((L==Value::BOOL) != (R==Value::BOOL)) {
+                    // comparing bool to numeric allowed by interpreter (coercion), but warn
+                    warnings.push_back("Comparison between boolean and numeric in '" + op + "'");
+                }
+                return Value::BOOL;
+            }
+            if (op=="&&"||op=="||") {
+                // logical: operands should be boolean (or at least coercible)
+                if (L!=Value::BOOL && L!=Value::INT && L!=Value::FLOAT) { errors.push_back("Invalid operand for logical operator '"+op+"'"); return Value::NONE; }
+                if (R!=Value::BOOL && R!=Value::INT && R!=Value::FLOAT) { errors.push_back("Invalid operand for logical operator '"+op+"'"); return Value::NONE; }
+                return Value::BOOL;
+            }
+            return Value::NONE;
+        }
+        if (node->node_type=="UnaryOp") {
+            string op = node->value;
+            Value::Type V = infer_expr_type(node->children[0]);
+            if (V==Value::NONE) return Value::NONE;
+            if (is_array_type(V)) { errors.push_back("Invalid operand type for unary '" + op + "' on array"); return Value::NONE; }
+            if (op=="-") {
+                if (V==Value::BOOL) { errors.push_back("Invalid operand type for unary '-' on boolean"); return Value::NONE; }
+                return (V==Value::FLOAT?Value::FLOAT:Value::INT);
+            }
+            if (op=="!") return Value::BOOL;
+        }
+        if (node->node_type=="Assign") {
+            // assignment is treated at statement level; here infer RHS
+            return infer_expr_type(node->children[0]);
+        }
+        // fallback
+        return Value::NONE;
+    }
+
+    // Checks an Index / IndexAssign target and its index, and marks the node
+    // in_bounds when the index is provably inside the array. Returns the
+    // element type.
+    Value::Type analyze_index(const shared_ptr<AST> &node) {
+        const string &name = node->value;
+        if (!is_declared(node->sym)) { errors.push_back("Undefined identifier '" + name + "'"); return Value::NONE; }
+        Value::Type at = lookup_var(node->sym);
+        if (!is_array_type(at)) { errors.push_back("Indexing non-array '" + name + "'"); return Value::NONE; }
+        const shared_ptr<AST> &index = node->children[0];
+        if (!parallel_loops.empty()) check_parallel_index(node);
+        Value::Type it = infer_expr_type(index);
+        if (it!=Value::NONE && it!=Value::INT) errors.push_back("Array index for '" + name + "' must be int, got " + type_to_string(it));
+        long long length = var_length(node->sym);
+        if (length >= 0 && it==Value::INT) {
+            long long lo, hi;
+            if (is_small_int_literal(index)) {
+                lo = hi = stoll(index->value);
+                if (hi >= length) { errors.push_back("Index " + index->value + " out of bounds for array '" + name + "' of length " + to_string(length)); return element_type(at); }
+            } else if (!index_range(index, lo, hi)) return element_type(at);
+            if (lo >= 0 && hi < length) node->in_bounds = true;
+        }
+        return element_type(at);
+    }
+
+    // Value range of an index expression that is a counted loop's variable
+    bool index_range(const shared_ptr<AST> &index, long long &lo, long long &hi) const {
+        if (index->node_type!="Identifier") return false;
+        for (auto it = loop_ranges.rbegin(); it != loop_ranges.rend(); ++it) {
+            if (it->sym == index->sym) { lo = it->lo; hi = it->hi; return true; }
+        }
+        return false;
+    }
+
+    Value::Type infer_builtin(const shared_ptr<AST> &node) {
+        const string &fname = node->value;
+        size_t want = (fname=="len" || fname=="sum") ? 1 : 2;
+        if (node->children.size() != want) { errors.push_back("Argument count mismatch in call to '" + fname + "'"); return Value::NONE; }
+        Value::Type a = infer_expr_type(node->children[0]);
+        Value::Type b = want==2 ? infer_expr_type(node->children[1]) : Value::NONE;
+        if (a==Value::NONE) return Value::NONE;
+        if (!is_array_type(a)) { errors.push_back("Argument 1 of '" + fname + "' must be an array, got " + type_to_string(a)); return Value::NONE; }
+        if (fname=="len") return Value::INT;
+        if (fname=="sum") return element_type(a);
+        if (fname=="dot") {
+            if (b==Value::NONE) return Value::NONE;
+            if (b!=a) { errors.push_back("Arguments of 'dot' must be arrays of the same type, got " + type_to_string(a) + " and " + type_to_string(b)); return Value::NONE; }
+            long long la = static_length(node->children[0]), lb = static_length(node->children[1]);
+            if (la>=0 && lb>=0 && la!=lb) errors.push_back("Array length mismatch in call to 'dot': " + to_string(la) + " vs " + to_string(lb));
+            return element_type(a);
+        }
+        // fill(array_variable, value)
+        if (node->children[0]->node_type!="Identifier") errors.push_back("Argument 1 of 'fill' must be an array variable");
+        else if (!parallel_loops.empty()) check_parallel_write(node->children[0]);
+        if (b!=Value::NONE && !compatible(element_type(a), b)) errors.push_back("Argument 2 type mismatch in call to 'fill': expected " + type_to_string(element_type(a)) + ", got " + type_to_string(b));
+        return Value::NONE;
+    }
+
+    // Declared length of an array VarDecl, or -1 (after reporting) if invalid
+    long long declared_length(const shared_ptr<AST> &decl) {
+        const string &text = decl->children[0]->value;
+        long long n = text.size() > 9 ? MAX_ARRAY_LENGTH + 1 : atoll(text.c_str());
+        if (n <= 0 || n > MAX_ARRAY_LENGTH) { errors.push_back("Invalid length " + text + " for array '" + decl->value + "'"); return -1; }
+        return n;
+    }
+
+    void check_array_init(const string &name, Value::Type vt, long long length, const shared_ptr<AST> &init) {
+        long long rl = static_length(init);
+        if (is_array_type(vt) && length>=0 && rl>=0 && rl!=length) errors.push_back("Array length mismatch in initializer for '" + name + "': expected " + to_string(length) + ", got " + to_string(rl));
+    }
+
+    void analyze_var_decl(const shared_ptr<AST> &node, const string &context_name, const string &function_name) {
+        if (!node) return;
+        string name = node->value;
+        string t = node->children[0]->node_type;
+        Value::Type vt = string_to_type(t);
+        if (vt==Value::NONE) { errors.push_back("Unknown type for variable '" + name + "'"); return; }
+        if (scope->declared_in_current(node->sym)) { errors.push_back("Redeclaration of variable '" + name + "' in " + context_name); return; }
+        if (scope->lookup(node->sym)) warnings.push_back("Shadowing of '" + name + "' in function '" + function_name + "'");
+        long long length = is_array_type(vt) ? declared_length(node) : 0;
+        // the initializer is checked before the name comes into scope
+        if (node->children.size()>=2) {
+            Value::Type rhs = infer_expr_type(node->children[1]);
+            if (rhs!=Value::NONE && !compatible(vt, rhs)) {
+                errors.push_back("Type mismatch in initializer for '" + name + "': expected " + type_to_string(vt) + ", got " + type_to_string(rhs));
+            } else check_array_init(name, vt, length, node->children[1]);
+        }
+        scope->declare(node->sym, vt, length);
+    }
+
+    // Known value range [lo, hi] of a counted loop's variable inside its body
+    struct LoopRange { int sym; long long lo, hi; };
+    vector<LoopRange> loop_ranges;
+
+    static bool writes_symbol(const shared_ptr<AST> &node, int sym) {
+        if (!node) return false;
+        if ((node->node_type=="Assign" || node->node_type=="VarDecl") && node->sym==sym) return true;
+        for (auto &c : node->children) if (writes_symbol(c, sym)) return true;
+        return false;
+    }
+
+    // Recognizes  for (var i:int = L; i < U; i = i + S) { ... }  (also <=)
+    // with integer literals L and S > 0, U a literal or len(array), and a body
+    // that never writes i. Inside such a body i stays within [L, U).
+    bool counted_loop(const shared_ptr<AST> &st, LoopRange &out) const {
+        if (st->children.size()<4) return false;
+        auto &init = st->children[0], &cond = st->children[1], &post = st->children[2], &body = st->children.back();
+        if (!init || !cond || !post) return false;
+        if (init->node_type!="VarDecl" || init->children[0]->node_type!="int" || init->children.size()<2 || !is_small_int_literal(init->children[1])) return false;
+        int sym = init->sym;
+        if (cond->node_type!="BinaryOp" || (cond->value!="<" && cond->value!="<=")) return false;
+        // operands the parser could not read are left null
+        if (!cond->children[0] || cond->children[0]->node_type!="Identifier" || cond->children[0]->sym!=sym) return false;
+        long long bound;
+        auto &limit = cond->children[1];
+        if (is_small_int_literal(limit)) bound = stoll(limit->value);
+        else if (limit && limit->node_type=="Call" && limit->value=="len" && is_array_builtin(limit) && limit->children.size()==1
+                 && limit->children[0]->node_type=="Identifier" && (bound = var_length(limit->children[0]->sym)) >= 0) {}
+        else return false;
+        if (post->node_type!="Assign" || post->sym!=sym) return false;
+        auto &step = post->children[0];
+        if (!step || step->node_type!="BinaryOp" || step->value!="+" || !step->children[0] || step->children[0]->node_type!="Identifier" || step->children[0]->sym!=sym
+            || !is_small_int_literal(step->children[1]) || stoll(step->children[1]->value) <= 0) return false;
+        if (writes_symbol(body, sym)) return false;
+        out = {sym, stoll(init->children[1]->value), cond->value=="<" ? bound - 1 : bound};
+        return true;
+    }
+
+    // Parallel for loops enclosing the statement being checked, innermost last.
+    // Anything bound outside a loop's body (globals, enclosing locals, the
+    // loop variable) is shared by its iterations, which may only write it
+    // through the declared reduction or, for arrays, at the loop index.
+    // Callees see globals only, so their reads are checked once the whole
+    // body is known, against the globals the loop actually writes.
+    struct ParallelLoop {
+        int body_depth; int var; int reduce_sym; string reduce_op; set<int> written_arrays;
+        bool reduce_global = false;                          // the reduction variable is a global
+        set<int> global_writes;                              // global arrays stored to at the loop index
+        vector<pair<string, const set<int>*>> callee_reads;  // (callee, globals it reads)
+    };
+    vector<ParallelLoop> parallel_loops;
+    const AST *reduction_operand = nullptr;  // the 's' of 's = s + e' while e is checked
+
+    static bool mentions_symbol(const shared_ptr<AST> &node, int sym) {
+        if (!node) return false;
+        if (node->sym==sym) return true;
+        for (auto &c : node->children) if (mentions_symbol(c, sym)) return true;
+        return false;
+    }
+    static bool contains_parallel(const shared_ptr<AST> &node) {
+        if (!node) return false;
+        if (node->node_type=="ParallelFor") return true;
+        for (auto &c : node->children) if (contains_parallel(c)) return true;
+        return false;
+    }
+    static void collect_index_writes(const shared_ptr<AST> &node, set<int> &out) {
+        if (!node) return;
+        if (node->node_type=="IndexAssign") out.insert(node->sym);
+        for (auto &c : node->children) collect_index_writes(c, out);
+    }
+
+    bool is_shared(const ParallelLoop &loop, int sym) const {
+        const ScopeStack::Binding *b = scope->lookup(sym);
+        return !b || b->depth < loop.body_depth;
+    }
+    bool is_loop_index(const ParallelLoop &loop, const shared_ptr<AST> &index) const {
+        if (index->node_type!="Identifier" || index->sym!=loop.var) return false;
+        const ScopeStack::Binding *b = scope->lookup(index->sym);
+        return b && b->depth == loop.body_depth - 1;
+    }
+
+    void check_parallel_read(const shared_ptr<AST> &id) {
+        for (auto &loop : parallel_loops) {
+            if (!is_shared(loop, id->sym)) continue;
+            if (id->sym==loop.reduce_sym && id.get()!=reduction_operand) {
+                errors.push_back("parallel for: reduction variable '" + id->value + "' may only be updated as '" + id->value + " = " + id->value + " " + loop.reduce_op + " ...'");
+            } else if (loop.written_arrays.count(id->sym)) {
+                errors.push_back("parallel for: array '" + id->value + "' is written by the loop and may only be accessed at the loop index");
+            }
+        }
+    }
+
+    void check_parallel_index(const shared_ptr<AST> &node) {
+        bool write = node->node_type=="IndexAssign";
+        for (auto &loop : parallel_loops) {
+            if (!is_shared(loop, node->sym)) continue;
+            if (write && !scope->lookup(node->sym)) loop.global_writes.insert(node->sym);
+            if (is_loop_index(loop, node->children[0])) continue;
+            if (write) errors.push_back("parallel for: write to shared array '" + node->value + "' must be indexed by the loop variable");
+            else if (loop.written_arrays.count(node->sym)) errors.push_back("parallel for: array '" + node->value + "' is written by the loop and may only be accessed at the loop index");
+        }
+    }
+
+    // st is an Assign (or the array argument of fill)
+    void check_parallel_write(const shared_ptr<AST> &st) {
+        for (auto &loop : parallel_loops) {
+            if (!is_shared(loop, st->sym)) continue;
+            if (st->sym==loop.reduce_sym && st->node_type=="Assign") {
+                // s = s op e (op chains such as s + a + b parse as (s + a) + b)
+                const AST *lhs = st->children[0].get();
+                bool same_op = true;
+                while (lhs->node_type=="BinaryOp") { same_op = same_op && lhs->value==loop.reduce_op; lhs = lhs->children[0].get(); }
+                if (lhs!=st->children[0].get() && lhs->node_type=="Identifier" && lhs->sym==st->sym) {
+                    // reported once here rather than again for the operand
+                    reduction_operand = lhs;
+                    if (same_op) continue;
+                }
+                errors.push_back("parallel for: reduction variable '" + st->value + "' may only be updated as '" + st->value + " = " + st->value + " " + loop.reduce_op + " ...'");
+                continue;
+            }
+            errors.push_back("parallel for: iteration writes shared variable '" + st->value + "'");
+        }
+    }
+
+    void check_parallel_call(const shared_ptr<AST> &call) {
+        const ResolvedNames::Effects &e = names->effects[call->sym];
+        for (auto &loop : parallel_loops) {
+            if (!e.writes.empty()) {
+                errors.push_back("parallel for: call to '" + call->value + "' writes shared global '" + names->names[*e.writes.begin()] + "'");
+                continue;
+            }
+            if (!e.reads.empty()) loop.callee_reads.push_back({call->value, &e.reads});
+        }
+    }
+    void check_callee_reads(const ParallelLoop &loop) {
+        for (auto &c : loop.callee_reads) {
+            for (int r : *c.second) {
+                if ((r==loop.reduce_sym && loop.reduce_global) || loop.global_writes.count(r)) {
+                    errors.push_back("parallel for: call to '" + c.first + "' reads '" + names->names[r] + "', which the loop writes");
+                    break;
+                }
+            }
+        }
+    }
+
+    // parallel for (var i:int = a; i < b; i = i + step): the trip count is
+    // known before the first iteration, so iterations can be handed out up front
+    bool parallel_form(const shared_ptr<AST> &st) const {
+        auto &init = st->children[0], &cond = st->children[1], &post = st->children[2];
+        if (!init || init->node_type!="VarDecl" || init->children[0]->node_type!="int" || init->children.size()<2) return false;
+        int sym = init->sym;
+        if (!cond || cond->node_type!="BinaryOp" || (cond->value!="<" && cond->value!="<=")) return false;
+        // operands the parser could not read are left null
+        if (!cond->children[0] || !cond->children[1] || cond->children[0]->node_type!="Identifier" || cond->children[0]->sym!=sym || mentions_symbol(cond->children[1], sym)) return false;
+        if (!post || post->node_type!="Assign" || post->sym!=sym) return false;
+        auto &step = post->children[0];
+        return step && step->node_type=="BinaryOp" && step->value=="+" && step->children[0] && step->children[0]->node_type=="Identifier" && step->children[0]->sym==sym
+            && is_small_int_literal(step->children[1]) && stoll(step->children[1]->value) > 0;
+    }
+
+    void analyze_parallel_for(const shared_ptr<AST> &st, const FunctionInfo &fi) {
+        // children: init, cond, post, Reduction?, body
+        auto &init = st->children[0], &body = st->children.back();
+        shared_ptr<AST> red = st->children.size()==5 ? st->children[3] : nullptr;
+        scope->push();
+        if (init->node_type=="VarDecl") analyze_var_decl(init, "for-loop", fi.name); else infer_expr_type(init);
+        auto &cond = st->children[1];
+        Value::Type bound = Value::NONE;
+        if (cond->node_type=="BinaryOp") { infer_expr_type(cond->children[0]); bound = infer_expr_type(cond->children[1]); }
+        else infer_expr_type(cond);
+        if (st->children[2]->node_type=="Assign") analyze_statement(st->children[2], fi); else infer_expr_type(st->children[2]);
+        bool form = parallel_form(st);
+        if (!form) errors.push_back("parallel for requires the form 'parallel for (var i:int = a; i < b; i = i + step)' with a constant positive step");
+        else if (bound!=Value::NONE && bound!=Value::INT) errors.push_back("parallel for: loop bound must be int, got " + type_to_string(bound));
+
+        ParallelLoop loop{scope->depth() + 1, form ? init->sym : -1, -1, "", {}, false, {}, {}};
+        if (red) {
+            auto &var = red->children[0];
+            if (!is_declared(var->sym)) errors.push_back("Undefined identifier '" + var->value + "'");
+            else if (form && var->sym==init->sym) errors.push_back("Reduction variable '" + var->value + "' cannot be the loop variable");
+            else {
+                Value::Type t = lookup_var(var->sym);
+                if (t!=Value::INT && t!=Value::FLOAT) errors.push_back("Reduction variable '" + var->value + "' must be int or float, got " + type_to_string(t));
+                loop.reduce_sym = var->sym; loop.reduce_op = red->value; loop.reduce_global = !scope->lookup(var->sym);
+            }
+        }
+        collect_index_writes(body, loop.written_arrays);
+        for (auto it = loop.written_arrays.begin(); it != loop.written_arrays.end();) it = is_declared(*it) ? next(it) : loop.written_arrays.erase(it);
+
+        LoopRange range;
+        bool counted = counted_loop(st, range);
+        if (counted) loop_ranges.push_back(range);
+        if (form) parallel_loops.push_back(move(loop));
+        analyze_block(body, fi);
+        if (form) { check_callee_reads(parallel_loops.back()); parallel_loops.pop_back(); }
+        if (counted) loop_ranges.pop_back();
+        scope->pop();
+    }
+
+    void analyze_block(const shared_ptr<AST> &block, const FunctionInfo &fi) {
+        scope->push();
+        for (auto &s : block->children) analyze_statement(s, fi);
+        scope->pop();
+    }
+
+    void analyze_statement(const shared_ptr<AST> &st, const FunctionInfo &fi) {
+        if (!st) return;
+        const string &current_ret_type = fi.return_type;
+        if (st->node_type=="VarDecl") { analyze_var_decl(st, "function", fi.name); return; }
+        if (st->node_type=="Assign") {
+            string name = st->value;
+            if (!is_declared(st->sym)) { errors.push_back("Assignment to undeclared variable '" + name + "'"); }
+            else if (!parallel_loops.empty()) check_parallel_write(st);
+            Value::Type rhs = infer_expr_type(st->children[0]);
+            reduction_operand = nullptr;
+            Value::Type dest = lookup_var(st->sym);
+            if (rhs!=Value::NONE && dest!=Value::NONE && !compatible(dest, rhs)) {
+                errors.push_back("Type mismatch in assignment to '" + name + "': expected " + type_to_string(dest) + ", got " + type_to_string(rhs));
+            } else if (is_array_type(dest)) {
+                long long rl = static_length(st->children[0]), dl = var_length(st->sym);
+                if (rl>=0 && dl>=0 && rl!=dl) errors.push_back("Array length mismatch in assignment to '" + name + "': expected " + to_string(dl) + ", got " + to_string(rl));
+            }
+            return;
+        }
+        if (st->node_type=="IndexAssign") {
+            Value::Type elem = analyze_index(st);
+            Value::Type rhs = infer_expr_type(st->children[1]);
+            if (rhs!=Value::NONE && elem!=Value::NONE && !compatible(elem, rhs)) {
+                errors.push_back("Type mismatch in assignment to element of '" + st->value + "': expected " + type_to_string(elem) + ", got " + type_to_string(rhs));
+            }
+            return;
+        }
+        if (st->node_type=="Print") { if (!st->children.empty()) infer_expr_type(st->children[0]); return; }
+        if (st->node_type=="If") {
+            infer_expr_type(st->children[0]);
+            analyze_block(st->children[1], fi);
+            if (st->children.size()>=3) analyze_block(st->children[2], fi);
+            return;
+        }
+        if (st->node_type=="While") {
+            infer_expr_type(st->children[0]);
+            analyze_block(st->children[1], fi);
+            return;
+        }
+        if (st->node_type=="For") {
+            // children: init?, cond?, post?, body; the init variable is scoped to the loop
+            scope->push();
+            if (st->children.size()>=1 && st->children[0]) {
+                if (st->children[0]->node_type=="VarDecl") analyze_var_decl(st->children[0], "for-loop", fi.name);
+                else infer_expr_type(st->children[0]);
+            }
+            if (st->children.size()>=2 && st->children[1]) infer_expr_type(st->children[1]);
+            if (st->children.size()>=3 && st->children[2]) {
+                if (st->children[2]->node_type=="Assign") analyze_statement(st->children[2], fi);
+                else infer_expr_type(st->children[2]);
+            }
+            LoopRange range;
+            bool counted = counted_loop(st, range);
+            if (counted) loop_ranges.push_back(range);
+            if (!st->children.empty()) analyze_block(st->children.back(), fi);
+            if (counted) loop_ranges.pop_back();
+            scope->pop();
+            return;
+        }
+        if (st->node_type=="ParallelFor") { analyze_parallel_for(st, fi); return; }
+        if (st->node_type=="Return") {
+            if (!parallel_loops.empty()) errors.push_back("parallel for: 'return' is not allowed in the loop body");
+            if (!st->children.empty()) {
+                Value::Type rv = infer_expr_type(st->children[0]);
+                Value::Type declared = string_to_type(current_ret_type);
+                if (rv!=Value::NONE && declared!=Value::NONE && !compatible(declared, rv)) {
+                    errors.push_back("Return type mismatch: function expects " + type_to_string(declared) + ", returned " + type_to_string(rv));
+                }
+            } else {
+                // void/none return: if function declares non-none return type, error
+                Value::Type declared = string_to_type(current_ret_type);
+                if (declared!=Value::NONE) errors.push_back("Missing return value in function that declares return type '" + current_ret_type + "'");
+            }
+            return;
+        }
+        if (st->node_type=="Block") { analyze_block(st, fi); return; }
+        // expression statements
+        infer_expr_type(st);
+    }
+
+    void analyze_function(const FunctionInfo &fi) {
+        // parameters and the top level of the body share the function scope
+        scope->push();
+        for (auto &p : fi.params) {
+            Value::Type pt = string_to_type(p.second);
+            int sym = names->ids.at(p.first);
+            if (pt==Value::NONE) { errors.push_back("Unknown parameter type for '" + p.first + "' in function '" + fi.name + "'"); }
+            if (scope->declared_in_current(sym)) { errors.push_back("Duplicate parameter name '" + p.first + "' in function '" + fi.name + "'"); }
+            scope->declare(sym, pt);
+        }
+        for (auto &st : fi.body->children) analyze_statement(st, fi);
+        scope->pop();
+    }
+
+    void run() {
+        if (!ast) return;
+        auto resolved = make_shared<ResolvedNames>();
+        resolved->resolve(ast);
+        size_t symbol_count = resolved->names.size();
+        resolved->global_types.assign(symbol_count, Value::NONE);
+        // every declared name occurs in the AST, so it already has an id
+        for (auto &kv : globals) { auto it = resolved->ids.find(kv.first); if (it != resolved->ids.end()) resolved->global_types[it->second] = kv.second; }
+        resolved->global_lengths.assign(symbol_count, 0);
+        vector<bool> declared(symbol_count, false);
+        for (auto &child : ast->children) {
+            if (child->node_type!="VarDecl") continue;
+            // a redeclared global holds each declaration's storage in turn, so
+            // its length is not known statically
+            if (declared[child->sym]) { resolved->global_lengths[child->sym] = -1; continue; }
+            declared[child->sym] = true;
+            if (is_array_type(string_to_type(child->children[0]->node_type))) {
+                const string &text = child->children[0]->value;
+                long long n = text.size() > 9 ? 0 : atoll(text.c_str());
+                if (n > 0 && n <= MAX_ARRAY_LENGTH) resolved->global_lengths[child->sym] = n;
+            }
+        }
+        resolved->function_infos.assign(symbol_count, nullptr);
+        for (auto &kv : *functions) { auto it = resolved->ids.find(kv.first); if (it != resolved->ids.end()) resolved->function_infos[it->second] = &kv.second; }
+        if (resolved->has_parallel) resolved->compute_effects();
+        names = resolved;
+        own_scope.reset(symbol_count);
+        scope = &own_scope;
+
+        // top-level: check global var initializers (every global is visible)
+        for (auto &child : ast->children) {
+            if (child->node_type=="VarDecl") {
+                string name = child->value; string t = child->children[0]->node_type; Value::Type vt = string_to_type(t);
+                long long length = is_array_type(vt) ? declared_length(child) : 0;
+                if (child->children.size()>=2) {
+                    Value::Type rhs = infer_expr_type(child->children[1]);
+                    if (rhs!=Value::NONE && !compatible(vt, rhs)) errors.push_back("Type mismatch in initializer for global '" + name + "': expected " + type_to_string(vt) + ", got " + type_to_string(rhs));
+                    else check_array_init(name, vt, length, child->children[1]);
+                }
+            }
+        }
+        // other top-level statements are only checked when they contain a
+        // parallel for, whose iterations must be proven independent before it runs
+        if (names->has_parallel) {
+            FunctionInfo top; top.name = "<top-level>";
+            for (auto &child : ast->children) {
+                if (child->node_type=="VarDecl" || child->node_type=="FunctionDecl" || !contains_parallel(child)) continue;
+                scope->push(); analyze_statement(child, top); scope->pop();
+            }
+        }
+        // functions, in source order (first declaration of each name)
+        vector<const FunctionInfo*> order;
+        vector<bool> seen(symbol_count, false);
+        for (auto &child : ast->children) {
+            if (child->node_type!="FunctionDecl" || seen[child->sym]) continue;
+            seen[child->sym] = true;
+            if (const FunctionInfo *fi = names->function_infos[child->sym]) order.push_back(fi);
+        }
+        unsigned threads = effective_jobs(jobs);
+        if (threads <= 1 || order.size() < PARALLEL_MIN_FUNCTIONS) {
+            for (auto *fi : order) analyze_function(*fi);
+            return;
+        }
+        // Each body only reads the shared tables, so bodies are checked
+        // concurrently into private buffers which are then appended in
+        // source order: the result is identical to the sequential loop.
+        // Scope tables are per participating thread and reused across bodies.
+        vector<vector<string>> fn_errors(order.size()), fn_warnings(order.size());
+        vector<ScopeStack> scopes(threads);
+        ThreadPool::shared().parallel_for(order.size(), threads, [&](size_t i, unsigned slot) {
+            if (scopes[slot].current.size() != symbol_count) scopes[slot].reset(symbol_count);
+            SemanticAnalyzer worker(ast, globals, *functions);
+            worker.names = names;
+            worker.scope = &scopes[slot];
+            worker.analyze_function(*order[i]);
+            fn_errors[i] = move(worker.errors);
+            fn_warnings[i] = move(worker.warnings);
+        });
+        for (size_t i=0;i<order.size();++i) {
+            errors.insert(errors.end(), fn_errors[i].begin(), fn_errors[i].end());
+            warnings.insert(warnings.end(), fn_warnings[i].begin(), fn_warnings[i].end());
+        }
+    }
+
+private:
+    shared_ptr<const ResolvedNames> names;
+    ScopeStack own_scope;
+    ScopeStack *scope = &own_scope;
+};
+
+struct Interpreter {
+    shared_ptr<AST> ast;
+    vector<string> errors;
+    vector<string> warnings;
+    string output;
+
+    unordered_map<string, Value::Type> globals;
+    unordered_map<string, Value> global_values;
+    unordered_map<string, FunctionInfo> functions;
+    vector<string> imported;  // imported function names, in the order they were added
+
+    // Set on the workers running a parallel for: they own only their frames
+    // and look everything else up in the interpreter that started the loop.
+    Interpreter *outer = nullptr;
+    // Threads a parallel for may use (0 = all available)
+    unsigned jobs = 0;
+
+    // Budget accounting, shared with parallel-for workers. Each interpreter
+    // spends a local allowance of steps and settles it with the meter only
+    // when it runs out, so the per-step cost is one decrement; the clock is
+    // read at settlement, never per statement. Array operations are charged
+    // a step per ARRAY_STEP elements, so a long array cannot stretch the time
+    // between settlements.
+    struct BudgetMeter {
+        Budget limits;
+        chrono::steady_clock::time_point started, deadline;
+        chrono::steady_clock::duration spent{0};  // running time before `started`
+        atomic<uint64_t> steps{0};
+        atomic<size_t> memory{0};  // bytes of live array storage
+        atomic<bool> tripped{false};
+        mutex m; string which;  // first limit hit
+        bool native = false;    // "depth" was MAX_NESTING, not max_depth
+    };
+    struct BudgetExceeded {};  // unwinds execution once any limit is hit
+    static const uint32_t BUDGET_BATCH = 1024;
+    static const size_t ARRAY_STEP = 1024;
+    shared_ptr<BudgetMeter> meter = make_shared<BudgetMeter>();
+    uint32_t ticks = 0, granted = 0;
+    size_t depth_base = 0;  // calls active in the outer interpreters
+    // execute_statement / eval_expression frames in use. A worker counts on
+    // from its outer interpreter, since it may run on the same thread.
+    int nesting = 0;
+    // Bytes this interpreter may still print. A parallel-for worker gets the
+    // room its loop started with and sets output_full when it runs out.
+    size_t output_room = SIZE_MAX;
+    bool output_full = false;
+
+    // Execution trace (CompileOptions::trace), shared with parallel-for
+    // workers; a traced run executes parallel for loops on one thread.
+    shared_ptr<TraceRecorder> trace;
+    uint32_t trace_module = 0;  // string id of the module whose code is running
+
+    Interpreter(shared_ptr<AST> a): ast(a) { grant(); }
+    explicit Interpreter(Interpreter *o): ast(o->ast), outer(o), jobs(o->jobs), meter(o->meter), depth_base(o->call_depth()), nesting(o->nesting), trace(o->trace), trace_module(o->trace_module) { grant(); }
+
+    void set_budget(const Budget &b) {
+        meter->limits = b;
+        meter->deadline = chrono::steady_clock::now() + chrono::milliseconds(b.max_time_ms);
+        output_room = b.max_output ? b.max_output : SIZE_MAX;
+        grant();
+    }
+    // max_time_ms counts execution only, so the clock is stopped while the
+    // program is analyzed
+    void start_clock() {
+        meter->started = chrono::steady_clock::now();
+        meter->deadline = meter->started + chrono::milliseconds(meter->limits.max_time_ms) - meter->spent;
+    }
+    void stop_clock() { meter->spent += chrono::steady_clock::now() - meter->started; }
+    void grant() {
+        uint64_t n = BUDGET_BATCH, max = meter->limits.max_steps;
+        if (max) {
+            // +1 so the step after the last allowed one is the one that trips;
+            // only added when below the batch, so it cannot overflow
+            uint64_t left = max - min<uint64_t>(meter->steps.load(memory_order_relaxed), max);
+            if (left < n) n = left + 1;
+        }
+        granted = ticks = (uint32_t)n;
+    }
+    void tick() { if (--ticks == 0) settle(); }
+    void charge(size_t elements) {
+        for (size_t n = elements / ARRAY_STEP; n;) {
+            uint32_t k = (uint32_t)min<size_t>(n, ticks);
+            ticks -= k; n -= k;
+            if (!ticks) settle();
+        }
+    }
+    // Report the steps taken since the last grant and check every limit
+    void settle() {
+        uint64_t used = meter->steps.fetch_add(granted - ticks) + (granted - ticks);
+        if (meter->tripped.load(memory_order_relaxed)) throw BudgetExceeded();
+        if (meter->limits.max_steps && used > meter->limits.max_steps) trip("steps");
+        if (meter->limits.max_time_ms && chrono::steady_clock::now() > meter->deadline) trip("time");
+        grant();
+    }
+    [[noreturn]] void trip(const char *which) {
+        {
+            lock_guard<mutex> lk(meter->m);
+            if (meter->which.empty()) meter->which = which;
+        }
+        meter->tripped = true;
+        throw BudgetExceeded();
+    }
+    // Deepest nesting of statements and expressions, across calls, that the
+    // interpreter recurses through. A level takes up to about 3 KB of native
+    // stack (sanitizer builds; a tenth of that otherwise), so this stays well
+    // inside STACK_BYTES (thread_pool.h) whatever max_depth allows.
+    static const int MAX_NESTING = 20000;
+    struct Nested {
+        Interpreter &in;
+        explicit Nested(Interpreter &i): in(i) {
+            if (++in.nesting > MAX_NESTING) { --in.nesting; in.too_deep(); }
+        }
+        ~Nested() { --in.nesting; }
+    };
+    [[noreturn]] void too_deep() {
+        {
+            lock_guard<mutex> lk(meter->m);
+            if (meter->which.empty()) meter->native = true;
+        }
+        trip("depth");
+    }
+    // Output past max_output stops the run. A worker only stops its own
+    // chunk: the loop cuts its output in chunk order when merging, so the
+    // output kept does not depend on which thread ran out first.
+    void emit(const string &text) {
+        if (text.size() > output_room) {
+            output.append(text, 0, output_room); output_room = 0;
+            out_of_output();
+        }
+        output_room -= text.size();
+        output += text;
+    }
+    [[noreturn]] void out_of_output() {
+        if (!outer) trip("output");
+        output_full = true;
+        throw BudgetExceeded();
+    }
+    void print_value(const Value &v) {
+        if (v.is_array()) charge(v.length());
+        emit(v.toString() + "\n");
+    }
+    // Error for the limit that stopped the run
+    string budget_error() const {
+        const Budget &b = meter->limits;
+        if (meter->which=="steps") return "Budget exceeded: more than " + to_string(b.max_steps) + " steps";
+        if (meter->which=="time") return "Budget exceeded: ran longer than " + to_string(b.max_time_ms) + " ms";
+        if (meter->which=="depth" && meter->native) return "Budget exceeded: statements and expressions nested deeper than " + to_string(MAX_NESTING);
+        if (meter->which=="depth") return "Budget exceeded: calls nested deeper than " + to_string(b.max_depth);
+        if (meter->which=="memory") return "Budget exceeded: more than " + to_string(b.max_memory) + " bytes of arrays";
+        return "Budget exceeded: more than " + to_string(b.max_output) + " bytes of output";
+    }
+
+    Value::Type type_from_string(const string &s) {
+        if (s=="int") return Value::INT;
+        if (s=="float") return Value::FLOAT;
+        if (s=="bool") return Value::BOOL;
+        if (s=="int[]") return Value::INT_ARRAY;
+        if (s=="float[]") return Value::FLOAT_ARRAY;
+        return Value::NONE;
+    }
+
+    // Zero-filled array of the type and length given by a VarDecl type node.
+    // Its storage counts against max_memory for as long as it is alive.
+    Value new_array(Value::Type t, size_t n) {
+        charge(n);
+        Value v; v.type = t;
+        if (size_t max = meter->limits.max_memory) {
+            size_t bytes = n * sizeof(int64_t);
+            if (meter->memory.fetch_add(bytes) + bytes > max) { meter->memory -= bytes; trip("memory"); }
+            shared_ptr<BudgetMeter> m = meter;
+            v.arr = shared_ptr<ArrayData>(new ArrayData, [m, bytes](ArrayData *d) { m->memory -= bytes; delete d; });
+        } else v.arr = make_shared<ArrayData>();
+        if (t==Value::INT_ARRAY) v.arr->ints.assign(n, 0); else v.arr->floats.assign(n, 0.0);
+        return v;
+    }
+    // 0 when the length is not one the analyzer accepts (top-level blocks are not analyzed)
+    static size_t declared_length(const shared_ptr<AST> &type_node) {
+        const string &text = type_node->value;
+        long long n = text.size() > 9 ? 0 : atoll(text.c_str());
+        return n > 0 && n <= SemanticAnalyzer::MAX_ARRAY_LENGTH ? (size_t)n : 0;
+    }
+
+    // Arrays have value semantics: storing one copies its elements into the
+    // destination's own storage, whose length is fixed by its declaration.
+    bool copy_elements(Value &dest, const Value &src, const string &name) {
+        if (!src.is_array() || src.type!=dest.type) return false;
+        if (src.length()!=dest.length()) {
+            errors.push_back("Array length mismatch in assignment to '" + name + "': expected " + to_string(dest.length()) + ", got " + to_string(src.length()));
+            return true;
+        }
+        if (src.arr!=dest.arr) { charge(src.length()); dest.arr->ints = src.arr->ints; dest.arr->floats = src.arr->floats; }
+        return true;
+    }
+    // Store into an existing variable. An array variable is never rebound to
+    // other storage: index accesses were proven in range against its length.
+    void store(Value &dest, const Value &v, const string &name) {
+        if (!dest.is_array() && !v.is_array()) { dest = v; return; }
+        if (!copy_elements(dest, v, name)) errors.push_back("Type mismatch in assignment to '" + name + "': expected " + type_name(dest.type) + ", got " + type_name(v.type));
+    }
+
+    // Slot holding a variable; nullptr when undefined. Lookup is lexical, like
+    // the analyzer's: the running function's frame (at top level, the locals
+    // of the enclosing blocks), then the globals.
+    Value *find_var(const string &name) {
+        auto &locals = callstack.empty() ? top_locals : callstack.back().locals;
+        auto it = locals.find(name);
+        if (it!=locals.end()) return &it->second;
+        // a worker's loop frame sits inside the code that started the loop
+        if (outer && callstack.size()==1) return outer->find_var(name);
+        return find_global(name);
+    }
+    Value *find_global(const string &name) {
+        if (outer) return outer->find_global(name);
+        auto it = global_values.find(name);
+        return it!=global_values.end() ? &it->second : nullptr;
+    }
+
+    const FunctionInfo *find_function(const string &name) const {
+        auto it = functions.find(name);
+        if (it!=functions.end()) return &it->second;
+        return outer ? outer->find_function(name) : nullptr;
+    }
+
+    Value::Type global_type(const string &name) const {
+        auto it = globals.find(name);
+        if (it!=globals.end()) return it->second;
+        return outer ? outer->global_type(name) : Value::NONE;
+    }
+
+    // Validates an element index; the check is skipped for accesses the
+    // analyzer proved in range.
+    bool check_index(const shared_ptr<AST> &node, const Value &a, const Value &idx) {
+        if (node->in_bounds) return true;
+        if (idx.i < 0 || (unsigned long long)idx.i >= a.length()) {
+            errors.push_back("Index " + to_string(idx.i) + " out of bounds for array '" + node->value + "' of length " + to_string(a.length()));
+            return false;
+        }
+        return true;
+    }
+
+    // Records global and function declarations without running any
+    // initializer, which is all the semantic analyzer needs.
+    void collect_decls() {
+        if (!ast) return;
+        for (auto &child : ast->children) {
+            if (child->node_type=="VarDecl") {
+                string name = child->value;
+                string t = child->children[0]->node_type;
+                Value::Type vt = type_from_string(t);
+                if (vt==Value::NONE) { errors.push_back("Unknown type for variable " + name); continue; }
+                if (globals.count(name)) warnings.push_back("Redeclaration of variable " + name);
+                globals[name] = vt;
+                Value v; v.type = vt; if (vt==Value::INT) v.i=0; if (vt==Value::FLOAT) v.f=0.0; if (vt==Value::BOOL) v.b=false;
+                global_values[name]=v;
+            } else if (child->node_type=="FunctionDecl") {
+                FunctionInfo fi; fi.name = child->value;
+                auto params = child->children[0];
+                for (auto &p : params->children) {
+                    string pname = p->value; string ptype = p->children[0]->node_type; fi.params.push_back({pname, ptype});
+                }
+                fi.return_type = child->children[1]->node_type;
+                fi.body = child->children[2];
+                auto prev = functions.find(fi.name);
+                if (prev != functions.end()) errors.push_back(prev->second.module.empty() ? "Redeclared function " + fi.name : "Function " + fi.name + " is already imported from module '" + prev->second.module + "'");
+                functions[fi.name] = fi;
+            }
+        }
+    }
+
+    // Allocates global arrays and runs the initializers in declaration order;
+    // only called once the program passed analysis. All storage comes first,
+    // so an initializer that reads a later global sees a real array. Once the
+    // budget runs out the rest stay uninitialized (the run is over anyway).
+    void init_globals() {
+        if (!ast) return;
+        vector<Value> storage;
+        try {
+            for (auto &child : ast->children) {
+                if (child->node_type!="VarDecl") continue;
+                Value::Type vt = type_from_string(child->children[0]->node_type);
+                if (vt!=Value::INT_ARRAY && vt!=Value::FLOAT_ARRAY) continue;
+                storage.push_back(new_array(vt, declared_length(child->children[0])));
+                Value &g = global_values[child->value];
+                if (!g.arr) g = storage.back();
+            }
+            size_t next = 0;
+            for (auto &child : ast->children) {
+                if (child->node_type!="VarDecl") continue;
+                string name = child->value;
+                Value::Type vt = type_from_string(child->children[0]->node_type);
+                // a redeclared global holds each declaration's value in turn
+                Value v; v.type = vt;
+                global_values[name] = v.is_array() ? storage[next++] : v;
+                if (child->children.size()>=2) {
+                    if (trace) trace->statement(child->line, child->pos, trace_module);
+                    Value init = eval_expression(child->children[1]);
+                    store(global_values[name], init, name);
+                    if (trace) trace->write(trace->intern(name), global_values[name]);
+                }
+            }
+        } catch (const BudgetExceeded &) { errors.push_back(budget_error()); }
+    }
+
+    struct Frame { unordered_map<string, Value> locals; };
+    vector<Frame> callstack;
+    // Calls in progress; a worker's first frame holds its loop variable, not a call
+    size_t call_depth() const { return depth_base + callstack.size() - (outer ? 1 : 0); }
+    bool has_return = false; Value return_value;
+
+    Value eval_expression(const shared_ptr<AST> &node) {
+        Value res; if (!node) { res.type = Value::NONE; return res; }
+        Nested nested(*this);
+        if (node->node_type=="Literal") {
+            string s = node->value;
+            if (s=="true" || s=="false") { res.type = Value::BOOL; res.b = (s=="true"); return res; }
+            if (s.find('.')!=string::npos) { res.type = Value::FLOAT; try { res.f = stod(s); } catch(...) { res.f=0.0; } return res; }
+            res.type = Value::INT; try { res.i = stoll(s); } catch(...) { res.i=0; } return res;
+        }
+        if (node->node_type=="Identifier") {
+            string name = node->value;
+            if (Value *v = find_var(name)) return *v;
+            errors.push_back("Undefined variable: " + name);
+            return res;
+        }
+        if (node->node_type=="Index") {
+            Value *a = find_var(node->value);
+            if (!a) { errors.push_back("Undefined variable: " + node->value); return res; }
+            Value idx = eval_expression(node->children[0]);
+            if (!a->is_array() || !check_index(node, *a, idx)) return res;
+            if (a->type==Value::INT_ARRAY) { res.type = Value::INT; res.i = a->arr->ints[idx.i]; }
+            else { res.type = Value::FLOAT; res.f = a->arr->floats[idx.i]; }
+            return res;
+        }
+        if (node->node_type=="IndexAssign") {
+            Value idx = eval_expression(node->children[0]);
+            Value v = eval_expression(node->children[1]);
+            Value *a = find_var(node->value);
+            if (!a) { errors.push_back("Undefined variable: " + node->value); return res; }
+            if (!a->is_array() || !check_index(node, *a, idx)) return res;
+            if (a->type==Value::INT_ARRAY) a->arr->ints[idx.i] = v.i;
+            else a->arr->floats[idx.i] = v.type==Value::FLOAT ? v.f : v.i;
+            if (trace) trace->index_write(trace->intern(node->value), idx.i, v);
+            return v;
+        }
+        if (node->node_type=="Assign") {
+            string name = node->value; Value v = eval_expression(node->children[0]);
+            if (trace) trace->write(trace->intern(name), v);
+            if (Value *dest = find_var(name)) { store(*dest, v, name); return *dest; }
+            Value &created = global_values[name];
+            if (v.is_array()) { created = new_array(v.type, v.length()); copy_elements(created, v, name); } else created = v;
+            warnings.push_back("Implicit global creation of " + name);
+            return v;
+        }
+        if (node->node_type=="Call") {
+            string fname = node->value;
+            if (fname=="print") {
+                if (node->children.size()>=1) {
+                    Value v = eval_expression(node->children[0]); print_value(v); return v;
+                } else { emit("\n"); Value v; v.type=Value::NONE; return v; }
+            }
+            const FunctionInfo *fip = find_function(fname);
+            if (!fip && (fname=="len" || fname=="sum" || fname=="dot" || fname=="fill")) return call_array_builtin(node);
+            if (!fip) { errors.push_back("Call to undefined function " + fname); return res; }
+            auto &fi = *fip;
+            if (node->children.size() != fi.params.size()) { errors.push_back("Argument count mismatch in call to " + fname); }
+            vector<Value> args; for (auto &ch : node->children) args.push_back(eval_expression(ch));
+            tick();
+            if (meter->limits.max_depth && call_depth() >= meter->limits.max_depth) trip("depth");
+            Frame f; for (size_t i=0;i<fi.params.size() && i<args.size();++i) f.locals[fi.params[i].first] = args[i];
+            uint32_t caller_module = trace_module;
+            if (trace) {
+                trace->call(trace->intern(fname), node->line, node->pos, trace_module);
+                trace_module = trace->intern(fi.module);
+                for (size_t i=0;i<fi.params.size() && i<args.size();++i) trace->write(trace->intern(fi.params[i].first), args[i]);
+            }
+            callstack.push_back(f);
+            execute_block(fi.body);
+            Value ret = return_value;
+            has_return = false; return_value = Value();
+            callstack.pop_back();
+            if (trace) { trace_module = caller_module; trace->ret(ret, node->line, node->pos, trace_module); }
+            return ret;
+        }
+        if (node->node_type=="BinaryOp") {
+            auto L = eval_expression(node->children[0]); auto R = eval_expression(node->children[1]); string op = node->value;
+            Value out;
+            if (L.is_array() || R.is_array()) return array_binary_op(op, L, R);
+            if (op=="+") {
+                if (L.type==Value::FLOAT || R.type==Value::FLOAT) { out.type=Value::FLOAT; out.f = (L.type==Value::FLOAT?L.f:L.i) + (R.type==Value::FLOAT?R.f:R.i); }
+                else { out.type=Value::INT; out.i = L.i + R.i; }
+            } else if (op=="-") {
+                if (L.type==Value::FLOAT || R.type==Value::FLOAT) { out.type=Value::FLOAT; out.f = (L.type==Value::FLOAT?L.f:L.i) - (R.type==Value::FLOAT?R.f:R.i); }
+                else { out.type=Value::INT; out.i = L.i - R.i; }
+            } else if (op=="*") {
+                if (L.type==Value::FLOAT || R.type==Value::FLOAT) { out.type=Value::FLOAT; out.f = (L.type==Value::FLOAT?L.f:L.i) * (R.type==Value::FLOAT?R.f:R.i); }
+                else { out.type=Value::INT; out.i = L.i * R.i; }
+            } else if (op=="/") {
+                if (R.type==Value::INT && R.i==0) { errors.push_back("Division by zero"); return out; }
+                if (R.type==Value::FLOAT && R.f==0.0) { errors.push_back("Division by zero"); return out; }
+                out.type = Value::FLOAT;
+                double lv = (L.type==Value::FLOAT?L.f:L.i);
+                double rv = (R.type==Value::FLOAT?R.f:R.i);
+                out.f = lv / rv;
+            } else if (op=="<" || op==">" || op=="<=" || op==">=") {
+                double lv = (L.type==Value::FLOAT?L.f:L.i);
+                double rv = (R.type==Value::FLOAT?R.f:R.i);
+                out.type = Value::BOOL;
+                if (op=="<") out.b = lv < rv;
+                else if (op==">") out.b = lv > rv;
+                else if (op=="<=") out.b = lv <= rv;
+                else out.b = lv >= rv;
+            } else if (op=="==" || op!="") {
+                out.type = Value::BOOL;
+                if (L.type==Value::BOOL || R.type==Value::BOOL) {
+                    bool lb = (L.type==Value::BOOL?L.b:(L.type==Value::FLOAT?L.f!=0.0:L.i!=0));
+                    bool rb = (R.type==Value::BOOL?R.b:(R.type==Value::FLOAT?R.f!=0.0:R.i!=0));
+                    out.b = (op=="==") ? (lb==rb) : (lb!=rb);
+                } else {
+                    double lv = (L.type==Value::FLOAT?L.f:L.i);
+                    double rv = (R.type==Value::FLOAT?R.f:R.i);
+                    out.b = (op=="==") ? (fabs(lv-rv) < 1e-9) : !(fabs(lv-rv) < 1e-9);
+                }
+            } else if (op=="&&") {
+                out.type = Value::BOOL;
+                bool lb = (L.type==Value::BOOL?L.b:(L.type==Value::FLOAT?L.f!=0.0:L.i!=0));
+                if (!lb) { out.b = false; return out; }
+                bool rb = (R.type==Value::BOOL?R.b:(R.type==Value::FLOAT?R.f!=0.0:R.i!=0));
+                out.b = rb;
+            } else if (op=="||") {
+                out.type = Value::BOOL;
+                bool lb = (L.type==Value::BOOL?L.b:(L.type==Value::FLOAT?L.f!=0.0:L.i!=0));
+                if (lb) { out.b = true; return out; }
+                bool rb = (R.type==Value::BOOL?R.b:(R.type==Value::FLOAT?R.f!=0.0:R.i!=0));
+                out.b = rb;
+            }
+            return out;
+        }
+        if (node->node_type=="UnaryOp") {
+            string op = node->value; auto V = eval_expression(node->children[0]); Value out;
+            if (op=="-") {
+                if (V.type==Value::FLOAT) { out.type=Value::FLOAT; out.f = -V.f; }
+                else { out.type=Value::INT; out.i = -V.i; }
+            } else if (op=="!") {
+                out.type = Value::BOOL;
+                bool vb = (V.type==Value::BOOL?V.b:(V.type==Value::FLOAT?V.f!=0.0:V.i!=0));
+                out.b = !vb;
+            }
+            return out;
+        }
+        if (node->node_type=="Call") {
+            return eval_expression(node); // handled above
+        }
+        return res;
+    }
+
+    // Element-wise + and * on two arrays of one type, through the SIMD kernels
+    Value array_binary_op(const string &op, const Value &L, const Value &R) {
+        Value out;
+        if (L.type!=R.type || (op!="+" && op!="*")) { errors.push_back("Invalid operands for '" + op + "'"); return out; }
+        size_t n = L.length();
+        if (R.length()!=n) { errors.push_back("Array length mismatch in element-wise '" + op + "': " + to_string(n) + " vs " + to_string(R.length())); return out; }
+        out = new_array(L.type, n);
+        charge(n);
+        if (L.type==Value::INT_ARRAY) {
+            if (op=="+") simd::add(L.arr->ints.data(), R.arr->ints.data(), out.arr->ints.data(), n);
+            else simd::mul(L.arr->ints.data(), R.arr->ints.data(), out.arr->ints.data(), n);
+        } else {
+            if (op=="+") simd::add(L.arr->floats.data(), R.arr->floats.data(), out.arr->floats.data(), n);
+            else simd::mul(L.arr->floats.data(), R.arr->floats.data(), out.arr->floats.data(), n);
+        }
+        return out;
+    }
+
+    // len(a), sum(a), dot(a, b), fill(a, v); shadowed by user functions of the same name
+    Value call_array_builtin(const shared_ptr<AST> &node) {
+        const string &fname = node->value; Value res;
+        size_t want = (fname=="len" || fname=="sum") ? 1 : 2;
+        if (node->children.size()!=want) { errors.push_back("Argument count mismatch in call to " + fname); return res; }
+        Value a = eval_expression(node->children[0]);
+        if (!a.is_array()) { errors.push_back("Argument 1 of " + fname + " must be an array"); return res; }
+        bool ints = a.type==Value::INT_ARRAY;
+        size_t n = a.length();
+        if (fname=="len") { res.type = Value::INT; res.i = (long long)n; return res; }
+        charge(n);
+        if (fname=="sum") {
+            if (ints) { res.type = Value::INT; res.i = simd::sum(a.arr->ints.data(), n); }
+            else { res.type = Value::FLOAT; res.f = simd::sum(a.arr->floats.data(), n); }
+            return res;
+        }
+        Value b = eval_expression(node->children[1]);
+        if (fname=="dot") {
+            if (b.type!=a.type || b.length()!=n) { errors.push_back("Array length mismatch in call to dot: " + to_string(n) + " vs " + to_string(b.length())); return res; }
+            if (ints) { res.type = Value::INT; res.i = simd::dot(a.arr->ints.data(), b.arr->ints.data(), n); }
+            else { res.type = Value::FLOAT; res.f = simd::dot(a.arr->floats.data(), b.arr->floats.data(), n); }
+            return res;
+        }
+        // fill writes through the shared storage of the named variable
+        if (ints) simd::fill(a.arr->ints.data(), n, (int64_t)(b.type==Value::FLOAT ? (long long)b.f : b.i));
+        else simd::fill(a.arr->floats.data(), n, b.type==Value::FLOAT ? b.f : (double)b.i);
+        res.type = Value::NONE;
+        return res;
+    }
+
+    // Block scoping: a VarDecl executed inside a block records the binding it
+    // replaced, and leaving the block puts it back, matching the scopes the
+    // semantic analyzer checks against.
+    // Top-level blocks keep their variables in top_locals rather than the
+    // globals, so functions called from them never see those.
+    struct ScopeUndo { string name; bool top; bool existed; Value prev; };
+    vector<ScopeUndo> scope_undo;
+    unordered_map<string, Value> top_locals;
+    int block_depth = 0;
+
+    void declare_var(const string &name, const Value &v) {
+        bool top = callstack.empty();
+        auto &table = !top ? callstack.back().locals : block_depth > 0 ? top_locals : global_values;
+        if (block_depth > 0) {
+            auto it = table.find(name);
+            scope_undo.push_back({name, top, it!=table.end(), it!=table.end() ? it->second : Value()});
+        }
+        table[name] = v;
+        if (trace) trace->write(trace->intern(name), v);
+    }
+
+    void leave_scope(size_t mark) {
+        while (scope_undo.size() > mark) {
+            auto &u = scope_undo.back();
+            auto &table = u.top ? top_locals : callstack.back().locals;
+            if (u.existed) table[u.name] = u.prev; else table.erase(u.name);
+            scope_undo.pop_back();
+        }
+    }
+
+    void execute_block(const shared_ptr<AST> &block) {
+        if (!block) return;
+        size_t mark = scope_undo.size(); ++block_depth;
+        for (auto &st : block->children) {
+            if (has_return) break;
+            execute_statement(st);
+            if (has_return) break;
+        }
+        --block_depth; leave_scope(mark);
+    }
+
+    void execute_statement(const shared_ptr<AST> &node) {
+        if (!node) return;
+        Nested nested(*this);
+        tick();
+        if (trace) trace->statement(node->line, node->pos, trace_module);
+        if (node->node_type=="VarDecl") {
+            string name = node->value; // type in child 0
+            Value::Type vt = type_from_string(node->children[0]->node_type);
+            if (vt==Value::INT_ARRAY || vt==Value::FLOAT_ARRAY) {
+                size_t n = declared_length(node->children[0]);
+                if (!n) { errors.push_back("Invalid length " + node->children[0]->value + " for array '" + name + "'"); return; }
+                Value v = new_array(vt, n);
+                if (node->children.size()>=2) store(v, eval_expression(node->children[1]), name);
+                declare_var(name, v);
+            } else if (node->children.size()>=2) {
+                Value v = eval_expression(node->children[1]);
+                declare_var(name, v);
+            } else {
+                Value v; v.type = global_type(name);
+                declare_var(name, v);
+            }
+            return;
+        }
+        if (node->node_type=="Assign" || node->node_type=="IndexAssign") { eval_expression(node); return; }
+        if (node->node_type=="Print") { auto v = eval_expression(node->children[0]); print_value(v); return; }
+        if (node->node_type=="If") {
+            Value c = eval_expression(node->children[0]); bool cond = (c.type==Value::BOOL?c.b:(c.type==Value::FLOAT?c.f!=0.0:c.i!=0));
+            if (cond) execute_block(node->children[1]); else if (node->children.size()>=3) execute_block(node->children[2]);
+            return;
+        }
+        if (node->node_type=="While") {
+            while (true) {
+                tick();
+                Value c = eval_expression(node->children[0]); if (has_return) return;
+                bool cond = (c.type==Value::BOOL?c.b:(c.type==Value::FLOAT?c.f!=0.0:c.i!=0));
+                if (!cond) break;
+                execute_block(node->children[1]); if (has_return) return;
+            }
+            return;
+        }
+        if (node->node_type=="For") {
+            if (node->children.size()>=4) {
+                // the init variable is scoped to the loop
+                size_t mark = scope_undo.size(); ++block_depth;
+                if (node->children[0]) execute_statement(node->children[0]);
+                while (true) {
+                    tick();
+                    if (node->children[1]) {
+                        Value c = eval_expression(node->children[1]); bool cond = (c.type==Value::BOOL?c.b:(c.type==Value::FLOAT?c.f!=0.0:c.i!=0));
+                        if (!cond) break;
+                    }
+                    execute_block(node->children.back()); if (has_return) break;
+                    if (node->children[2]) eval_expression(node->children[2]);
+                }
+                --block_depth; leave_scope(mark);
+            }
+            return;
+        }
+        if (node->node_type=="ParallelFor") { execute_parallel_for(node); return; }
+        if (node->node_type=="Return") {
+            if (!node->children.empty()) return_value = eval_expression(node->children[0]);
+            has_return = true; return;
+        }
+        if (node->node_type=="Block") { execute_block(node); return; }
+        eval_expression(node);
+    }
+
+    // A parallel for's iterations are cut into chunks whose boundaries depend
+    // only on the trip count. Chunks run on the shared thread pool, each in a
+    // worker interpreter of the participating thread, and their output,
+    // diagnostics and reduction partials are merged in chunk order, so the
+    // result is the same for every thread count. The analyzer has already
+    // checked that iterations only share reads, loop-index array stores and
+    // the reduction. If a budget limit stops the loop, the output of the
+    // chunks up to the first unfinished one is kept.
+    static const size_t PARALLEL_CHUNKS = 256;
+
+    struct Chunk { string output; vector<string> errors, warnings; Value partial; bool complete = false, output_full = false; };
+
+    static Value reduction_identity(const string &op, Value::Type t) {
+        Value v; v.type = t;
+        if (t==Value::FLOAT) v.f = op=="*" ? 1.0 : 0.0; else v.i = op=="*" ? 1 : 0;
+        return v;
+    }
+    static Value reduce(const string &op, const Value &a, const Value &b) {
+        Value out;
+        if (a.type==Value::FLOAT || b.type==Value::FLOAT) {
+            double x = a.type==Value::FLOAT ? a.f : a.i, y = b.type==Value::FLOAT ? b.f : b.i;
+            out.type = Value::FLOAT; out.f = op=="*" ? x * y : x + y;
+        } else { out.type = Value::INT; out.i = op=="*" ? a.i * b.i : a.i + b.i; }
+        return out;
+    }
+
+    void execute_parallel_for(const shared_ptr<AST> &node) {
+        // children: init, cond, post, Reduction?, body (shape checked by the analyzer)
+        auto &init = node->children[0], &cond = node->children[1];
+        shared_ptr<AST> red = node->children.size()==5 ? node->children[3] : nullptr;
+        Value lo = eval_expression(init->children[1]), hi = eval_expression(cond->children[1]);
+        long long step = stoll(node->children[2]->children[0]->children[1]->value);
+        long long last = cond->value=="<" ? hi.i - 1 : hi.i;
+        if (last < lo.i) return;
+        unsigned long long count = ((unsigned long long)last - (unsigned long long)lo.i) / step + 1;
+
+        Value *target = nullptr; Value identity;
+        if (red) {
+            target = find_var(red->children[0]->value);
+            if (!target) { errors.push_back("Undefined variable: " + red->children[0]->value); return; }
+            identity = reduction_identity(red->value, target->type);
+        }
+        size_t chunk_size = (size_t)((count + PARALLEL_CHUNKS - 1) / PARALLEL_CHUNKS);
+        size_t chunk_count = (size_t)((count + chunk_size - 1) / chunk_size);
+        vector<Chunk> chunks(chunk_count);
+        unsigned threads = trace ? 1 : effective_jobs(jobs);
+        vector<unique_ptr<Interpreter>> workers(threads);
+        bool stopped = false;
+        atomic<size_t> cutoff{chunk_count};  // first chunk known to fill the output; later ones are never merged
+        try {
+            ThreadPool::shared().parallel_for(chunk_count, threads, [&](size_t c, unsigned slot) {
+                if (c > cutoff.load(memory_order_relaxed)) return;
+                if (!workers[slot]) workers[slot].reset(new Interpreter(this));
+                unsigned long long begin = (unsigned long long)c * chunk_size, end = min<unsigned long long>(count, begin + chunk_size);
+                workers[slot]->run_iterations(node, lo.i + (long long)(begin * step), end - begin, step, identity, chunks[c]);
+                if (chunks[c].output_full) {
+                    size_t cur = cutoff.load();
+                    while (c < cur && !cutoff.compare_exchange_weak(cur, c)) {}
+                }
+            });
+        } catch (const BudgetExceeded &) { stopped = true; }
+
+        Value acc = identity;
+        for (auto &c : chunks) {
+            errors.insert(errors.end(), c.errors.begin(), c.errors.end());
+            warnings.insert(warnings.end(), c.warnings.begin(), c.warnings.end());
+            emit(c.output);
+            if (!c.complete) {
+                if (c.output_full) out_of_output();
+                break;
+            }
+            if (red) acc = reduce(red->value, acc, c.partial);
+        }
+        if (stopped) throw BudgetExceeded();
+        if (red) *target = reduce(red->value, *target, acc);
+    }
+
+    // Worker side: one chunk of iterations in a fresh frame holding the loop
+    // variable and this chunk's reduction partial.
+    void run_iterations(const shared_ptr<AST> &node, long long first, unsigned long long count, long long step, const Value &identity, Chunk &out) {
+        const string &var = node->children[0]->value;
+        shared_ptr<AST> red = node->children.size()==5 ? node->children[3] : nullptr;
+        callstack.emplace_back();
+        if (red) callstack[0].locals[red->children[0]->value] = identity;
+        output_room = outer->output_room; output_full = false;
+        try {
+            for (unsigned long long k=0;k<count;++k) {
+                tick();
+                Value i; i.type = Value::INT; i.i = first + (long long)(k * step);
+                callstack[0].locals[var] = i;
+                if (trace) trace->write(trace->intern(var), i);
+                execute_block(node->children.back());
+            }
+            settle();  // so steps are not lost when this worker goes away
+            out.complete = true;
+        } catch (const BudgetExceeded &) {}
+        if (red && out.complete) out.partial = callstack[0].locals[red->children[0]->value];
+        out.output = move(output); output.clear();
+        out.errors = move(errors); errors.clear();
+        out.warnings = move(warnings); warnings.clear();
+        out.output_full = output_full;
+        callstack.clear();
+        if (!out.complete && !out.output_full) throw BudgetExceeded();
+    }
+};
+
+
+// Loads the targets of `import "file.minic";`. A module may only contain
+// functions and imports; all imported functions, including those of nested
+// imports, share one namespace. A module that checks clean is cached as a
+// binary interface (snapshot format: signatures and checked bodies) stamped
+// with the hash of its source and of each module it imported, so an unchanged
+// import costs a file hash and a snapshot load instead of a full compile.
+// Sources may be untrusted: every module must be a regular file of bounded
+// size inside the import directory.
+struct ModuleLoader {
+    struct Module {
+        string name, path;  // as first imported / resolved
+        uint64_t hash = 0;
+        vector<FunctionInfo> functions;
+        vector<shared_ptr<Module>> deps;
+    };
+    const CompileOptions &opts;
+    string root;  // resolved import_dir
+    vector<string> errors, warnings;
+    unordered_map<string, shared_ptr<Module>> loaded;  // by resolved path; nullptr if it failed
+    vector<pair<string, string>> active;               // (path, name) chain being loaded
+
+    static const uintmax_t MAX_MODULE_BYTES = 4 << 20;
+
+    ModuleLoader(const CompileOptions &o): opts(o), root(resolve(o.import_dir, ".")) {}
+
+    // FNV-1a
+    static uint64_t hash_bytes(const string &s) {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (unsigned char c : s) { h ^= c; h *= 0x100000001b3ULL; }
+        return h;
+    }
+    // Source of a module; false with the reason in err if it may not be imported
+    bool read_module(const string &path, string &out, string &err) const {
+        filesystem::path rel = filesystem::path(path).lexically_relative(root);
+        if (rel.empty() || *rel.begin() == "..") { err = "outside the import directory"; return false; }
+        error_code ec;
+        if (!filesystem::is_regular_file(path, ec)) { err = "not a readable file"; return false; }
+        uintmax_t size = filesystem::file_size(path, ec);
+        if (ec) { err = "not a readable file"; return false; }
+        if (size > MAX_MODULE_BYTES) { err = "larger than " + to_string(MAX_MODULE_BYTES) + " bytes"; return false; }
+        ifstream in(path, ios::binary);
+        if (!in) { err = "not a readable file"; return false; }
+        out.resize((size_t)size);
+        in.read(&out[0], (streamsize)size);
+        out.resize((size_t)in.gcount());
+        return true;
+    }
+    // Absolute, with symbolic links resolved as far as the path exists
+    static string resolve(const string &dir, const string &name) {
+        error_code ec;
+        filesystem::path p = filesystem::absolute(filesystem::path(dir) / name, ec);
+        filesystem::path c = filesystem::weakly_canonical(p, ec);
+        return (ec ? p.lexically_normal() : c).string();
+    }
+    string cache_path(const string &path) const {
+        if (opts.module_cache.empty()) return path + ".mci";
+        // one directory for every module: tell same-named files apart by their path
+        char tag[17]; snprintf(tag, sizeof(tag), "%016llx", (unsigned long long)hash_bytes(path));
+        return (filesystem::path(opts.module_cache) / (filesystem::path(path).filename().string() + "." + tag + ".mci")).string();
+    }
+
+    // Imports of a program into its interpreter, dependencies first
+    void import_into(Interpreter &interp, const shared_ptr<AST> &prog, const string &dir) {
+        vector<shared_ptr<Module>> direct;
+        for (auto &child : prog->children) {
+            if (child->node_type!="Import") continue;
+            if (auto m = load(child->value, dir)) direct.push_back(m);
+        }
+        unordered_map<const Module*, bool> added;
+        for (auto &m : direct) add_functions(interp, *m, added);
+    }
+
+private:
+    void add_functions(Interpreter &interp, const Module &m, unordered_map<const Module*, bool> &added) {
+        if (added[&m]) return;
+        added[&m] = true;
+        for (auto &d : m.deps) add_functions(interp, *d, added);
+        for (auto &fi : m.functions) {
+            auto it = interp.functions.find(fi.name);
+            if (it != interp.functions.end()) { errors.push_back("Function '" + fi.name + "' from module '" + m.name + "' is already defined in module '" + it->second.module + "'"); continue; }
+            interp.functions.emplace(fi.name, fi);
+            interp.imported.push_back(fi.name);
+        }
+    }
+
+    shared_ptr<Module> load(const string &name, const string &dir) {
+        if (filesystem::path(name).has_root_path()) { errors.push_back("Cannot import module '" + name + "': absolute paths are not allowed"); return nullptr; }
+        return load_path(resolve(dir, name), name);
+    }
+
+    shared_ptr<Module> load_path(const string &path, const string &name) {
+        auto it = loaded.find(path);
+        if (it != loaded.end()) return it->second;
+        auto cyc = find_if(active.begin(), active.end(), [&](const pair<string,string> &a){ return a.first==path; });
+        if (cyc != active.end()) {
+            string chain;
+            for (; cyc != active.end(); ++cyc) chain += cyc->second + " -> ";
+            errors.push_back("Import cycle: " + chain + name);
+            return nullptr;
+        }
+        string src, err;
+        if (!read_module(path, src, err)) { errors.push_back("Cannot import module '" + name + "': " + err); loaded[path] = nullptr; return nullptr; }
+        auto m = make_shared<Module>();
+        m->name = name; m->path = path; m->hash = hash_bytes(src);
+        active.push_back({path, name});
+        bool ok = load_cached(*m) || compile(*m, move(src));
+        active.pop_back();
+        if (!ok) m = nullptr;
+        loaded[path] = m;
+        return m;
+    }
+
+    bool load_cached(Module &m) {
+        ProgramImage img; string err;
+        if (!load_snapshot(cache_path(m.path), img, err) || img.source_hash != m.hash) return false;
+        vector<shared_ptr<Module>> deps;
+        for (auto &imp : img.imports) {
+            // recorded paths are already resolved
+            auto d = load_path(imp.first, imp.first);
+            if (!d || d->hash != imp.second) return false;
+            deps.push_back(d);
+        }
+        m.deps = move(deps);
+        // the cache only saves lexing and parsing: anyone who can write it
+        // could change the tree, so the module is analyzed again (which also
+        // re-derives the index checks it may skip); on errors it is compiled
+        // from source instead
+        vector<string> errs, warns;
+        if (!check(m, img.ast, errs, warns)) { m.deps.clear(); m.functions.clear(); return false; }
+        for (auto &w : warns) warnings.push_back("In module '" + m.name + "': " + w);
+        return true;
+    }
+
+    // Declarations and analysis of a parsed module whose imports are in
+    // m.deps; fills m.functions if it checks clean. errs holds the errors so
+    // far on entry and all of them on return.
+    bool check(Module &m, const shared_ptr<AST> &ast, vector<string> &errs, vector<string> &warns) {
+        Interpreter mi(ast);
+        mi.errors = move(errs);
+        for (auto &child : ast->children) {
+            if (child->node_type!="FunctionDecl" && child->node_type!="Import") { mi.errors.push_back("Only functions and imports are allowed in a module"); break; }
+        }
+        unordered_map<const Module*, bool> added;
+        for (auto &d : m.deps) add_functions(mi, *d, added);
+        mi.collect_decls();
+        SemanticAnalyzer analyzer(ast, mi.globals, mi.functions, opts.jobs);
+        analyzer.run();
+        mi.errors.insert(mi.errors.end(), analyzer.errors.begin(), analyzer.errors.end());
+        mi.warnings.insert(mi.warnings.end(), analyzer.warnings.begin(), analyzer.warnings.end());
+        errs = move(mi.errors); warns = move(mi.warnings);
+        if (!errs.empty()) return false;
+
+        unordered_map<string, bool> seen;
+        for (auto &child : ast->children) {
+            if (child->node_type!="FunctionDecl" || seen[child->value]) continue;
+            seen[child->value] = true;
+            FunctionInfo fi = mi.functions.at(child->value);
+            fi.module = m.name;
+            m.functions.push_back(fi);
+        }
+        return true;
+    }
+
+    bool compile(Module &m, string src) {
+        vector<string> errs;
+        auto tokens = tokenize(src, errs);
+        Parser p(move(tokens));
+        auto ast = p.parse_program();
+        errs.insert(errs.end(), p.errors.begin(), p.errors.end());
+
+        ProgramImage img;
+        img.ast = ast; img.source_hash = m.hash;
+        string dir = filesystem::path(m.path).parent_path().string();
+        bool deps_ok = true;
+        for (auto &child : ast->children) {
+            if (child->node_type!="Import") continue;
+            auto d = load(child->value, dir);
+            if (!d) { deps_ok = false; continue; }
+            m.deps.push_back(d);
+            img.imports.push_back({d->path, d->hash});
+        }
+        vector<string> warns;
+        bool ok = check(m, ast, errs, warns);
+        for (auto &e : errs) errors.push_back("In module '" + m.name + "': " + e);
+        for (auto &w : warns) warnings.push_back("In module '" + m.name + "': " + w);
+        if (!deps_ok || !ok) return false;
+        img.functions = m.functions;
+        img.warnings = move(warns);
+        // the cache is an optimization: an unwritable location just means recompiling next time
+        string err;
+        save_snapshot(cache_path(m.path), img, err);
+        return true;
+    }
+};
+
+static bool parse_name_list(const string &spec, const vector<pair<string,unsigned>> &names, unsigned &mask, const string &what, string &err) {
+    mask = 0;
+    size_t start = 0;
+    while (start <= spec.size()) {
+        size_t comma = spec.find(',', start);
+        if (comma == string::npos) comma = spec.size();
+        string item = spec.substr(start, comma-start);
+        if (!item.empty()) {
+            auto it = find_if(names.begin(), names.end(), [&](const pair<string,unsigned> &n){ return n.first==item; });
+            if (it == names.end()) { err = "Unknown " + what + " '" + item + "'"; return false; }
+            mask |= it->second;
+        }
+        start = comma + 1;
+    }
+    if (!mask) { err = "Empty " + what + " list"; return false; }
+    return true;
+}
+
+bool parse_phases(const string &spec, CompileOptions &opts, string &err) {
+    static const vector<pair<string,unsigned>> names = {
+        {"lex",PHASE_LEX},{"parse",PHASE_PARSE},{"sema",PHASE_SEMA},{"run",PHASE_RUN}
+    };
+    unsigned mask;
+    if (!parse_name_list(spec, names, mask, "phase", err)) return false;
+    // phases form a pipeline: stop after the latest one requested
+    opts.last_phase = PHASE_LEX;
+    for (auto &n : names) if (mask & n.second) opts.last_phase = (Phase)n.second;
+    return true;
+}
+
+bool parse_emit(const string &spec, CompileOptions &opts, string &err) {
+    static const vector<pair<string,unsigned>> names = {
+        {"tokens",EMIT_TOKENS},{"ast",EMIT_AST},{"symbols",EMIT_SYMBOLS},
+        {"functions",EMIT_FUNCTIONS},{"diagnostics",EMIT_DIAGNOSTICS},{"output",EMIT_OUTPUT}
+    };
+    return parse_name_list(spec, names, opts.emit, "emit section", err);
+}
+
+// Capture a checked program right before its top-level statements run. The
+// tables follow declaration order so a loaded snapshot rebuilds identical maps.
+static ProgramImage make_image(const Interpreter &interp) {
+    ProgramImage img;
+    img.ast = interp.ast;
+    unordered_map<string, bool> seen_global, seen_function;
+    // imported functions were added first, so they come first here too
+    for (auto &name : interp.imported) {
+        auto it = interp.functions.find(name);
+        if (it != interp.functions.end() && !it->second.module.empty()) img.functions.push_back(it->second);
+    }
+    for (auto &child : interp.ast->children) {
+        if (child->node_type=="VarDecl" && interp.globals.count(child->value) && !seen_global[child->value]) {
+            seen_global[child->value] = true;
+            img.globals.push_back({child->value, interp.globals.at(child->value)});
+            img.global_values.push_back({child->value, interp.global_values.at(child->value)});
+        } else if (child->node_type=="FunctionDecl" && !seen_function[child->value]) {
+            seen_function[child->value] = true;
+            img.functions.push_back(interp.functions.at(child->value));
+        }
+    }
+    // globals created by assignment instead of a declaration, in name order
+    vector<pair<string, Value>> implicit;
+    for (auto &kv : interp.global_values) if (!seen_global[kv.first]) implicit.push_back(kv);
+    sort(implicit.begin(), implicit.end(), [](const pair<string, Value> &a, const pair<string, Value> &b) { return a.first < b.first; });
+    img.global_values.insert(img.global_values.end(), implicit.begin(), implicit.end());
+    img.warnings = interp.warnings;
+    img.output = interp.output;
+    return img;
+}
+
+// Run the top-level statements (when requested and the program is clean) and
+// move the requested sections into the result.
+static void finish_program(Interpreter &interp, bool run, const CompileOptions &opts, CompileResult &r) {
+    auto &ast = interp.ast;
+    bool keep_ast = (opts.emit & EMIT_AST) != 0;
+    if (run && interp.errors.empty()) {
+        interp.start_clock();
+        try {
+            for (auto &child : ast->children) {
+                if (!child || child->node_type=="FunctionDecl" || child->node_type=="Import") continue;
+                interp.execute_statement(child);
+                // top-level statements run exactly once; function bodies stay
+                // alive through the function table
+                if (!keep_ast) child.reset();
+                if (!interp.errors.empty()) break;
+            }
+        } catch (const Interpreter::BudgetExceeded &) { interp.errors.push_back(interp.budget_error()); }
+    }
+    if (interp.trace) {
+        string err;
+        if (!interp.trace->save(opts.trace, err)) interp.errors.push_back("Failed to write trace: " + err);
+    }
+
+    if (keep_ast) r.ast = ast;
+    if (opts.emit & EMIT_SYMBOLS) r.globals = move(interp.globals);
+    if (opts.emit & EMIT_FUNCTIONS) r.functions = move(interp.functions);
+    if (opts.emit & EMIT_DIAGNOSTICS) { r.errors = move(interp.errors); r.warnings = move(interp.warnings); r.budget_exceeded = interp.meter->which; }
+    if (opts.emit & EMIT_OUTPUT) r.output = move(interp.output);
+}
+
+static CompileResult compile_program(string src, const CompileOptions &opts) {
+    CompileResult r;
+    r.emit = opts.emit;
+
+    // Strip UTF-8 BOM if present (prevents illegal-character tokens for BOM bytes)
+    if (src.size() >= 3 && (unsigned char)src[0] == 0xEF && (unsigned char)src[1] == 0xBB && (unsigned char)src[2] == 0xBF) {
+        src = src.substr(3);
+    }
+
+    vector<string> lex_errors;
+    auto tokens = tokenize(src, lex_errors);
+    src = string();
+    if (opts.last_phase == PHASE_LEX) {
+        if (opts.emit & EMIT_TOKENS) r.tokens = move(tokens);
+        if (opts.emit & EMIT_DIAGNOSTICS) r.errors = move(lex_errors);
+        return r;
+    }
+
+    Parser p(move(tokens));
+    auto ast = p.parse_program();
+    // the parser owns the only copy of the token stream; release it now
+    // unless the caller wants it back
+    if (opts.emit & EMIT_TOKENS) r.tokens = move(p.toks); else vector<Token>().swap(p.toks);
+
+    Interpreter interp(ast);
+    interp.jobs = opts.jobs;
+    interp.errors.insert(interp.errors.end(), lex_errors.begin(), lex_errors.end());
+    interp.errors.insert(interp.errors.end(), p.errors.begin(), p.errors.end());
+
+    bool run = opts.last_phase == PHASE_RUN;
+    if (opts.last_phase >= PHASE_SEMA) {
+        ModuleLoader modules(opts);
+        modules.import_into(interp, ast, opts.import_dir);
+        interp.errors.insert(interp.errors.end(), modules.errors.begin(), modules.errors.end());
+        interp.warnings.insert(interp.warnings.end(), modules.warnings.begin(), modules.warnings.end());
+
+        interp.collect_decls();
+        SemanticAnalyzer analyzer(ast, interp.globals, interp.functions, opts.jobs);
+        analyzer.run();
+        interp.errors.insert(interp.errors.end(), analyzer.errors.begin(), analyzer.errors.end());
+        interp.warnings.insert(interp.warnings.end(), analyzer.warnings.begin(), analyzer.warnings.end());
+
+        // initializers are code too, so nothing runs until analysis has passed;
+        // a snapshot stores initialized globals, so saving one needs them run
+        interp.set_budget(opts.budget);
+        if (run && !opts.trace.empty()) interp.trace = make_shared<TraceRecorder>(opts.trace_limit);
+        if ((run || !opts.save_snapshot.empty()) && interp.errors.empty()) {
+            interp.start_clock();
+            interp.init_globals();
+            interp.stop_clock();
+        }
+
+        if (!opts.save_snapshot.empty() && interp.errors.empty()) {
+            string err;
+            if (!save_snapshot(opts.save_snapshot, make_image(interp), err)) interp.errors.push_back("Failed to save snapshot: " + err);
+        }
+    }
+
+    finish_program(interp, run, opts, r);
+    return r;
+}
+
+// Analysis of the imported functions of a loaded snapshot. Their modules'
+// ASTs are not stored, so the bodies are checked as a program of just their
+// declarations; a module has no globals and sees only its imports.
+static void analyze_imported(Interpreter &interp, unsigned jobs) {
+    auto prog = make_shared<AST>("Program");
+    unordered_map<string, FunctionInfo> imported;
+    for (auto &name : interp.imported) {
+        const FunctionInfo &fi = interp.functions.at(name);
+        auto params = make_shared<AST>("Params");
+        for (auto &p : fi.params) {
+            auto pn = make_shared<AST>("Param"); pn->value = p.first; pn->children.push_back(make_shared<AST>(p.second));
+            params->children.push_back(pn);
+        }
+        auto decl = make_shared<AST>("FunctionDecl"); decl->value = fi.name;
+        decl->children = {params, make_shared<AST>(fi.return_type), fi.body};
+        prog->children.push_back(decl);
+        imported.emplace(name, fi);
+    }
+    unordered_map<string, Value::Type> no_globals;
+    SemanticAnalyzer analyzer(prog, no_globals, imported, jobs);
+    analyzer.run();
+    interp.errors.insert(interp.errors.end(), analyzer.errors.begin(), analyzer.errors.end());
+}
+
+static CompileResult run_loaded(const string &path, const CompileOptions &opts) {
+    CompileResult r;
+    r.emit = opts.emit;
+    ProgramImage img; string err;
+    if (!load_snapshot(path, img, err)) {
+        if (opts.emit & EMIT_DIAGNOSTICS) r.errors.push_back("Failed to load snapshot: " + err);
+        return r;
+    }
+    // Only the AST, the imported function bodies and the global values come
+    // from the file. The tables are rebuilt from the AST and everything is
+    // analyzed again, which also re-derives the index checks it may skip.
+    Interpreter interp(img.ast);
+    interp.jobs = opts.jobs;
+    for (auto &fi : img.functions) {
+        if (fi.module.empty() || interp.functions.count(fi.name)) continue;
+        interp.imported.push_back(fi.name);
+        string name = fi.name; interp.functions.emplace(name, move(fi));
+    }
+    interp.collect_decls();
+    SemanticAnalyzer analyzer(img.ast, interp.globals, interp.functions, opts.jobs);
+    analyzer.run();
+    interp.errors.insert(interp.errors.end(), analyzer.errors.begin(), analyzer.errors.end());
+    analyze_imported(interp, opts.jobs);
+    // the analysis relied on each declared global having its declared type
+    // and (last) declared length
+    unordered_map<string, const AST*> decls;
+    for (auto &child : img.ast->children) if (child->node_type=="VarDecl") decls[child->value] = child.get();
+    size_t restored = 0;
+    for (auto &v : img.global_values) {
+        auto d = decls.find(v.first);
+        if (d == decls.end()) continue;
+        const Value &val = v.second;
+        if (val.type != interp.globals[v.first] || (val.is_array() && val.length() != Interpreter::declared_length(d->second->children[0]))) {
+            interp.errors.push_back("value of global '" + v.first + "' does not match its declaration");
+        }
+        ++restored;
+    }
+    if (restored != decls.size()) interp.errors.push_back("missing global values");
+    if (!interp.errors.empty()) {
+        if (opts.emit & EMIT_DIAGNOSTICS) for (auto &e : interp.errors) r.errors.push_back("Failed to load snapshot: " + e);
+        return r;
+    }
+
+    interp.warnings = move(img.warnings);
+    interp.set_budget(opts.budget);
+    // the stored output and arrays count against this run's budget
+    try {
+        for (auto &v : img.global_values) {
+            Value &val = v.second;
+            if (val.is_array()) {
+                Value a = interp.new_array(val.type, val.length());
+                a.arr->ints.swap(val.arr->ints); a.arr->floats.swap(val.arr->floats);
+                val = a;
+            }
+            interp.global_values[v.first] = val;
+        }
+        interp.emit(img.output);
+    } catch (const Interpreter::BudgetExceeded &) { interp.errors.push_back(interp.budget_error()); }
+    if (opts.last_phase == PHASE_RUN && !opts.trace.empty()) interp.trace = make_shared<TraceRecorder>(opts.trace_limit);
+    finish_program(interp, opts.last_phase == PHASE_RUN, opts, r);
+    return r;
+}
+
+// The front end and the interpreter recurse as deep as the program nests, so
+// both run on a thread whose stack is known to be deep enough
+CompileResult compile_source(string src, const CompileOptions &opts) {
+    CompileResult r;
+    run_with_stack([&]{ r = compile_program(move(src), opts); });
+    return r;
+}
+
+CompileResult run_snapshot(const string &path, const CompileOptions &opts) {
+    CompileResult r;
+    run_with_stack([&]{ r = run_loaded(path, opts); });
+    return r;
+}
+
+string type_name(Value::Type t) {
+    if (t==Value::INT) return "int";
+    if (t==Value::FLOAT) return "float";
+    if (t==Value::BOOL) return "bool";
+    if (t==Value::INT_ARRAY) return "int[]";
+    if (t==Value::FLOAT_ARRAY) return "float[]";
+    return "none";
+}
+
+string result_to_json(const CompileResult &r) {
+    vector<string> sections;
+    if (r.emit & EMIT_TOKENS) {
+        ostringstream out;
+        out << "  \"tokens\": [\n";
+        for (size_t i=0;i<r.tokens.size();++i) {
+            out << "    {\"type\": \"" << escape_json(r.tokens[i].type) << "\", \"text\": \"" << escape_json(r.tokens[i].text) << "\", \"line\": " << r.tokens[i].line << ", \"pos\": " << r.tokens[i].pos << "}";
+            if (i+1<r.tokens.size()) out << ",\n"; else out << "\n";
+        }
+        out << "  ]";
+        sections.push_back(out.str());
+    }
+    if (r.emit & EMIT_AST) sections.push_back("  \"ast\": " + ast_to_json(r.ast,2));
+    if (r.emit & EMIT_SYMBOLS) {
+        ostringstream out;
+        out << "  \"symbol_table\": {\n";
+        size_t cnt=0; for (auto &kv : r.globals) {
+            out << "    \"" << escape_json(kv.first) << "\": \"" << type_name(kv.second) << "\"";
+            if (++cnt < r.globals.size()) out << ",\n"; else out << "\n";
+        }
+        out << "  }";
+        sections.push_back(out.str());
+    }
+    if (r.emit & EMIT_FUNCTIONS) {
+        ostringstream out;
+        out << "  \"function_table\": {\n";
+        size_t cnt=0; for (auto &kv : r.functions) {
+            out << "    \"" << escape_json(kv.first) << "\": {\n";
+            out << "      \"return_type\": \"" << escape_json(kv.second.return_type) << "\",\n";
+            out << "      \"params\": [";
+            for (size_t i=0;i<kv.second.params.size();++i) {
+                out << "{\"name\": \"" << escape_json(kv.second.params[i].first) << "\", \"type\": \"" << escape_json(kv.second.params[i].second) << "\"}";
+                if (i+1<kv.second.params.size()) out << ", ";
+            }
+            out << "]\n    }";
+            if (++cnt < r.functions.size()) out << ",\n"; else out << "\n";
+        }
+        out << "  }";
+        sections.push_back(out.str());
+    }
+    if (r.emit & EMIT_DIAGNOSTICS) {
+        ostringstream out;
+        out << "  \"errors\": [\n";
+        for (size_t i=0;i<r.errors.size();++i) {
+            out << "    \"" << escape_json(r.errors[i]) << "\"";
+            if (i+1<r.errors.size()) out << ",\n"; else out << "\n";
+        }
+        out << "  ],\n";
+        out << "  \"warnings\": [\n";
+        for (size_t i=0;i<r.warnings.size();++i) {
+            out << "    \"" << escape_json(r.warnings[i]) << "\"";
+            if (i+1<r.warnings.size()) out << ",\n"; else out << "\n";
+        }
+        out << "  ]";
+        if (!r.budget_exceeded.empty()) out << ",\n  \"budget_exceeded\": \"" << r.budget_exceeded << "\"";
+        sections.push_back(out.str());
+    }
+    if (r.emit & EMIT_OUTPUT) sections.push_back("  \"output\": \"" + escape_json(r.output) + "\"");
+
+    string out = "{\n";
+    for (size_t i=0;i<sections.size();++i) {
+        out += sections[i];
+        out += (i+1<sections.size()) ? ",\n" : "\n";
+    }
+    out += "}\n";
+    return out;
+}
@@ -0,0 +1,146 @@
+// MiniC core: lexer, parser, semantic analyzer and interpreter shared by the
+// minic_backend executable and the minic_native Python extension.
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct Token {
+    std::string type;
+    std::string text;
+    int line;
+    int pos;
+};
+
+struct AST {
+    std::string node_type;
+    std::string value;
+    std::vector<std::shared_ptr<AST>> children;
+    int sym = -1;  // interned name id, assigned and read by semantic analysis only
+    bool in_bounds = false;  // Index proven in range by the analyzer; no runtime check
+    int line = 0, pos = 0;   // first token of a statement or call (Token::line / pos)
+    AST(std::string t): node_type(t) {}
+    ~AST();
+};
+
+// Deepest AST the front end builds or a snapshot may hold: the analyzer,
+// interpreter and serializers walk trees recursively, the last ones on the
+// caller's stack.
+static const int MAX_AST_DEPTH = 1000;
+
+// Contiguous, unboxed element storage of a fixed-size array. Only the vector
+// matching the array's element type is used.
+struct ArrayData {
+    std::vector<int64_t> ints;
+    std::vector<double> floats;
+};
+
+struct Value {
+    enum Type { INT, FLOAT, BOOL, NONE, INT_ARRAY, FLOAT_ARRAY } type = NONE;
+    long long i = 0;
+    double f = 0.0;
+    bool b = false;
+    // Elements of an INT_ARRAY / FLOAT_ARRAY value. Reading an array variable
+    // shares its storage; declarations and assignments copy elements.
+    std::shared_ptr<ArrayData> arr;
+    bool is_array() const { return type==INT_ARRAY || type==FLOAT_ARRAY; }
+    size_t length() const { return !arr ? 0 : type==INT_ARRAY ? arr->ints.size() : arr->floats.size(); }
+    std::string toString() const;
+};
+
+struct FunctionInfo {
+    std::string name;
+    std::vector<std::pair<std::string,std::string>> params;
+    std::string return_type;
+    std::shared_ptr<AST> body;
+    std::string module;  // import name of the defining module; empty for the main program
+};
+
+// Pipeline phases, in execution order. Compilation stops after last_phase.
+enum Phase { PHASE_LEX=1, PHASE_PARSE=2, PHASE_SEMA=4, PHASE_RUN=8 };
+
+// Result sections; anything not requested is neither built nor serialized.
+enum EmitSection {
+    EMIT_TOKENS=1, EMIT_AST=2, EMIT_SYMBOLS=4, EMIT_FUNCTIONS=8,
+    EMIT_DIAGNOSTICS=16, EMIT_OUTPUT=32, EMIT_ALL=63
+};
+
+// Limits on executing a program (global initializers and top-level
+// statements); 0 disables a limit. A run that hits one stops at once, keeps the
+// output printed so far and reports which limit it was in
+// CompileResult::budget_exceeded. Steps are counted and the clock is read in
+// batches, so with parallel for loops a run may overshoot max_steps by a few
+// thousand steps per thread.
+struct Budget {
+    uint64_t max_steps = 0;     // statements, loop iterations, calls, and one per 1024 array elements processed
+    unsigned max_time_ms = 0;   // wall clock spent running, not analyzing
+    unsigned max_depth = 1000;  // nested calls (the native stack is guarded separately)
+    size_t max_output = 0;      // bytes printed
+    size_t max_memory = 0;      // bytes of array storage alive at once
+};
+
+struct CompileOptions {
+    Phase last_phase = PHASE_RUN;
+    unsigned emit = EMIT_ALL;
+    // When set and the program checks clean, write a snapshot of it here
+    // (see snapshot.h) before its top-level statements execute.
+    std::string save_snapshot;
+    // Worker threads for semantic analysis and parallel for loops; 0 uses
+    // every available core. Diagnostics and output are identical for any value.
+    unsigned jobs = 0;
+    // Directory the main program's `import "file.minic";` paths are
+    // resolved against; a module's own imports resolve against its directory.
+    std::string import_dir = ".";
+    // Where compiled module interfaces are cached. Empty stores each one
+    // beside its module as <file>.mci.
+    std::string module_cache;
+    Budget budget;
+    // When set, record an execution trace of the run to this file (see
+    // trace.h), keeping the most recent trace_limit bytes of it.
+    std::string trace;
+    size_t trace_limit = 64 << 20;
+};
+
+// Parse the comma-separated lists accepted by --phases= / --emit=
+// (e.g. "lex,parse,sema" or "diagnostics,output"). On failure err is set.
+bool parse_phases(const std::string &spec, CompileOptions &opts, std::string &err);
+bool parse_emit(const std::string &spec, CompileOptions &opts, std::string &err);
+
+// Everything a single compile produces; mirrors the JSON document emitted by
+// minic_backend and the dict returned by minic_native.compile().
+struct CompileResult {
+    unsigned emit = EMIT_ALL;
+    std::vector<Token> tokens;
+    std::shared_ptr<AST> ast;
+    std::unordered_map<std::string, Value::Type> globals;
+    std::unordered_map<std::string, FunctionInfo> functions;
+    std::vector<std::string> errors;
+    std::vector<std::string> warnings;
+    std::string output;
+    // "steps", "time", "depth", "output" or "memory" when a Budget limit
+    // stopped the run (also reported in errors); empty otherwise. Part of the
+    // diagnostics.
+    std::string budget_exceeded;
+};
+
+std::vector<Token> tokenize(const std::string &code, std::vector<std::string> &errors);
+
+// Runs the pipeline (lex, parse, collect, check, execute) on one source text,
+// up to opts.last_phase. Does not touch any global state, so it is safe to
+// call concurrently.
+CompileResult compile_source(std::string src, const CompileOptions &opts = CompileOptions());
+
+// Load a snapshot written via CompileOptions::save_snapshot and run it,
+// skipping lexing, parsing and the global initializers. The program is
+// analyzed again, since the file may not be one this build wrote; its stored
+// output and arrays count against opts.budget. The token stream is not
+// stored, so the tokens section is always empty.
+CompileResult run_snapshot(const std::string &path, const CompileOptions &opts = CompileOptions());
+
+std::string type_name(Value::Type t);
+std::string escape_json(const std::string &s);
+std::string ast_to_json(const std::shared_ptr<AST> &node, int indent=0);
+std::string result_to_json(const CompileResult &r);
@@ -0,0 +1,304 @@
+// minic_native: in-process CPython binding for the MiniC backend.
+//
+//   import minic_native
+//   result = minic_native.compile(code)
+//   diags  = minic_native.compile(code, phases="sema", emit="diagnostics")
+//   minic_native.compile(code, save_snapshot="prog.snap")
+//   again  = minic_native.run_snapshot("prog.snap", emit="output")
+//   capped = minic_native.compile(code, max_steps=10**7, max_time_ms=2000)
+//   minic_native.compile(code, trace="run.trace")
+//   page   = minic_native.read_trace("run.trace", start=5000, count=100)
+//
+// The returned dict has the same shape as the JSON document printed by
+// minic_backend; phases/emit take the same lists as --phases= / --emit=.
+// The GIL is released while the pipeline runs, so Flask worker threads can
+// compile concurrently. A program stopped by one of the max_*
+// limits reports it in "errors" and as "budget_exceeded" ("steps", "time",
+// "depth", "output" or "memory"), next to the output printed before it stopped.
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "minic.h"
+#include "trace.h"
+
+#include <exception>
+#include <string>
+
+using namespace std;
+
+static PyObject *py_str(const string &s) {
+    // Illegal-character diagnostics can carry a lone byte of a multi-byte
+    // sequence, so never fail on malformed UTF-8.
+    return PyUnicode_DecodeUTF8(s.data(), (Py_ssize_t)s.size(), "replace");
+}
+
+// Steals the reference to `value`; returns false (with an exception set) on failure.
+static bool set_item(PyObject *dict, const char *key, PyObject *value) {
+    if (!value) return false;
+    int rc = PyDict_SetItemString(dict, key, value);
+    Py_DECREF(value);
+    return rc == 0;
+}
+
+static bool set_item(PyObject *dict, const string &key, PyObject *value) {
+    if (!value) return false;
+    PyObject *k = py_str(key);
+    if (!k) { Py_DECREF(value); return false; }
+    int rc = PyDict_SetItem(dict, k, value);
+    Py_DECREF(k); Py_DECREF(value);
+    return rc == 0;
+}
+
+static PyObject *string_list(const vector<string> &items) {
+    PyObject *list = PyList_New((Py_ssize_t)items.size());
+    if (!list) return nullptr;
+    for (size_t i=0;i<items.size();++i) {
+        PyObject *s = py_str(items[i]);
+        if (!s) { Py_DECREF(list); return nullptr; }
+        PyList_SET_ITEM(list, (Py_ssize_t)i, s);
+    }
+    return list;
+}
+
+static PyObject *tokens_to_py(const vector<Token> &tokens) {
+    PyObject *list = PyList_New((Py_ssize_t)tokens.size());
+    if (!list) return nullptr;
+    for (size_t i=0;i<tokens.size();++i) {
+        PyObject *d = PyDict_New();
+        if (!d || !set_item(d, "type", py_str(tokens[i].type)) || !set_item(d, "text", py_str(tokens[i].text))
+            || !set_item(d, "line", PyLong_FromLong(tokens[i].line)) || !set_item(d, "pos", PyLong_FromLong(tokens[i].pos))) {
+            Py_XDECREF(d); Py_DECREF(list); return nullptr;
+        }
+        PyList_SET_ITEM(list, (Py_ssize_t)i, d);
+    }
+    return list;
+}
+
+static PyObject *ast_to_py(const shared_ptr<AST> &node) {
+    if (!node) Py_RETURN_NONE;
+    PyObject *d = PyDict_New();
+    if (!d) return nullptr;
+    if (!set_item(d, "type", py_str(node->node_type))) { Py_DECREF(d); return nullptr; }
+    if (!node->value.empty() && !set_item(d, "value", py_str(node->value))) { Py_DECREF(d); return nullptr; }
+    if (!node->children.empty()) {
+        PyObject *children = PyList_New((Py_ssize_t)node->children.size());
+        if (!children) { Py_DECREF(d); return nullptr; }
+        for (size_t i=0;i<node->children.size();++i) {
+            PyObject *c = ast_to_py(node->children[i]);
+            if (!c) { Py_DECREF(children); Py_DECREF(d); return nullptr; }
+            PyList_SET_ITEM(children, (Py_ssize_t)i, c);
+        }
+        if (!set_item(d, "children", children)) { Py_DECREF(d); return nullptr; }
+    }
+    return d;
+}
+
+static PyObject *symbols_to_py(const unordered_map<string, Value::Type> &globals) {
+    PyObject *d = PyDict_New();
+    if (!d) return nullptr;
+    for (auto &kv : globals) {
+        if (!set_item(d, kv.first, py_str(type_name(kv.second)))) { Py_DECREF(d); return nullptr; }
+    }
+    return d;
+}
+
+static PyObject *functions_to_py(const unordered_map<string, FunctionInfo> &functions) {
+    PyObject *d = PyDict_New();
+    if (!d) return nullptr;
+    for (auto &kv : functions) {
+        PyObject *fd = PyDict_New();
+        PyObject *params = fd ? PyList_New((Py_ssize_t)kv.second.params.size()) : nullptr;
+        if (!params) { Py_XDECREF(fd); Py_DECREF(d); return nullptr; }
+        for (size_t i=0;i<kv.second.params.size();++i) {
+            PyObject *pd = PyDict_New();
+            if (!pd || !set_item(pd, "name", py_str(kv.second.params[i].first)) || !set_item(pd, "type", py_str(kv.second.params[i].second))) {
+                Py_XDECREF(pd); Py_DECREF(params); Py_DECREF(fd); Py_DECREF(d); return nullptr;
+            }
+            PyList_SET_ITEM(params, (Py_ssize_t)i, pd);
+        }
+        if (!set_item(fd, "return_type", py_str(kv.second.return_type)) || !set_item(fd, "params", params)) {
+            Py_DECREF(fd); Py_DECREF(d); return nullptr;
+        }
+        if (!set_item(d, kv.first, fd)) { Py_DECREF(d); return nullptr; }
+    }
+    return d;
+}
+
+static PyObject *result_to_py(const CompileResult &r) {
+    PyObject *d = PyDict_New();
+    if (!d) return nullptr;
+    if (((r.emit & EMIT_TOKENS) && !set_item(d, "tokens", tokens_to_py(r.tokens)))
+        || ((r.emit & EMIT_AST) && !set_item(d, "ast", ast_to_py(r.ast)))
+        || ((r.emit & EMIT_SYMBOLS) && !set_item(d, "symbol_table", symbols_to_py(r.globals)))
+        || ((r.emit & EMIT_FUNCTIONS) && !set_item(d, "function_table", functions_to_py(r.functions)))
+        || ((r.emit & EMIT_DIAGNOSTICS) && (!set_item(d, "errors", string_list(r.errors)) || !set_item(d, "warnings", string_list(r.warnings))))
+        || ((r.emit & EMIT_DIAGNOSTICS) && !r.budget_exceeded.empty() && !set_item(d, "budget_exceeded", py_str(r.budget_exceeded)))
+        || ((r.emit & EMIT_OUTPUT) && !set_item(d, "output", py_str(r.output)))) {
+        Py_DECREF(d); return nullptr;
+    }
+    return d;
+}
+
+// Fill in the limits parsed as K / n; false (with ValueError set) if negative
+static bool set_budget(Budget &budget, unsigned long long max_steps, Py_ssize_t max_output, Py_ssize_t max_memory) {
+    if (max_output < 0) { PyErr_SetString(PyExc_ValueError, "max_output must not be negative"); return false; }
+    if (max_memory < 0) { PyErr_SetString(PyExc_ValueError, "max_memory must not be negative"); return false; }
+    budget.max_steps = max_steps; budget.max_output = (size_t)max_output; budget.max_memory = (size_t)max_memory;
+    return true;
+}
+
+// trace / trace_limit keywords into opts; false (with ValueError set) if the limit is negative
+static bool set_trace(CompileOptions &opts, const char *trace, Py_ssize_t trace_limit) {
+    if (trace_limit < 0) { PyErr_SetString(PyExc_ValueError, "trace_limit must not be negative"); return false; }
+    if (trace) opts.trace = trace;
+    opts.trace_limit = (size_t)trace_limit;
+    return true;
+}
+
+static PyObject *minic_compile(PyObject *, PyObject *args, PyObject *kwargs) {
+    static const char *kwlist[] = {"code", "phases", "emit", "save_snapshot", "jobs", "import_dir", "module_cache",
+                                   "max_steps", "max_time_ms", "max_depth", "max_output", "max_memory", "trace", "trace_limit", nullptr};
+    const char *code = nullptr; Py_ssize_t len = 0;
+    const char *phases = nullptr, *emit = nullptr, *snapshot = nullptr, *import_dir = nullptr, *module_cache = nullptr, *trace = nullptr;
+    unsigned int jobs = 0;
+    Budget budget; unsigned long long max_steps = 0; Py_ssize_t max_output = 0, max_memory = 0;
+    Py_ssize_t trace_limit = (Py_ssize_t)CompileOptions().trace_limit;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s#|zzzIzzKIInnzn:compile", (char **)kwlist, &code, &len, &phases, &emit, &snapshot, &jobs, &import_dir, &module_cache,
+                                     &max_steps, &budget.max_time_ms, &budget.max_depth, &max_output, &max_memory, &trace, &trace_limit)) return nullptr;
+    if (!set_budget(budget, max_steps, max_output, max_memory)) return nullptr;
+    string src(code, (size_t)len);
+
+    CompileOptions opts; string err;
+    if ((phases && !parse_phases(phases, opts, err)) || (emit && !parse_emit(emit, opts, err))) {
+        PyErr_SetString(PyExc_ValueError, err.c_str()); return nullptr;
+    }
+    if (snapshot) opts.save_snapshot = snapshot;
+    if (import_dir) opts.import_dir = import_dir;
+    if (module_cache) opts.module_cache = module_cache;
+    opts.jobs = jobs;
+    opts.budget = budget;
+    if (!set_trace(opts, trace, trace_limit)) return nullptr;
+
+    CompileResult result;
+    bool failed = false; string failure;
+    Py_BEGIN_ALLOW_THREADS
+    try { result = compile_source(move(src), opts); }
+    catch (const exception &e) { failed = true; failure = e.what(); }
+    catch (...) { failed = true; failure = "unknown C++ exception"; }
+    Py_END_ALLOW_THREADS
+
+    if (failed) { PyErr_SetString(PyExc_RuntimeError, failure.c_str()); return nullptr; }
+    return result_to_py(result);
+}
+
+static PyObject *minic_run_snapshot(PyObject *, PyObject *args, PyObject *kwargs) {
+    static const char *kwlist[] = {"path", "emit", "jobs", "max_steps", "max_time_ms", "max_depth", "max_output", "max_memory", "trace", "trace_limit", nullptr};
+    const char *path = nullptr, *emit = nullptr, *trace = nullptr;
+    unsigned int jobs = 0;
+    Budget budget; unsigned long long max_steps = 0; Py_ssize_t max_output = 0, max_memory = 0;
+    Py_ssize_t trace_limit = (Py_ssize_t)CompileOptions().trace_limit;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|zIKIInnzn:run_snapshot", (char **)kwlist, &path, &emit, &jobs,
+                                     &max_steps, &budget.max_time_ms, &budget.max_depth, &max_output, &max_memory, &trace, &trace_limit)) return nullptr;
+    if (!set_budget(budget, max_steps, max_output, max_memory)) return nullptr;
+
+    CompileOptions opts; string err;
+    if (emit && !parse_emit(emit, opts, err)) { PyErr_SetString(PyExc_ValueError, err.c_str()); return nullptr; }
+    opts.jobs = jobs;
+    opts.budget = budget;
+    if (!set_trace(opts, trace, trace_limit)) return nullptr;
+    string snapshot_path(path);
+
+    CompileResult result;
+    bool failed = false; string failure;
+    Py_BEGIN_ALLOW_THREADS
+    try { result = run_snapshot(snapshot_path, opts); }
+    catch (const exception &e) { failed = true; failure = e.what(); }
+    catch (...) { failed = true; failure = "unknown C++ exception"; }
+    Py_END_ALLOW_THREADS
+
+    if (failed) { PyErr_SetString(PyExc_RuntimeError, failure.c_str()); return nullptr; }
+    return result_to_py(result);
+}
+
+static PyObject *trace_value_to_py(const TraceEvent &e) {
+    const Value &v = e.value;
+    if (v.type==Value::INT) return PyLong_FromLongLong(v.i);
+    if (v.type==Value::FLOAT) return PyFloat_FromDouble(v.f);
+    if (v.type==Value::BOOL) return PyBool_FromLong(v.b);
+    Py_RETURN_NONE;
+}
+
+static PyObject *trace_events_to_py(const vector<TraceEvent> &events) {
+    PyObject *list = PyList_New((Py_ssize_t)events.size());
+    if (!list) return nullptr;
+    for (size_t i=0;i<events.size();++i) {
+        const TraceEvent &e = events[i];
+        bool has_value = e.kind==TraceEvent::WRITE || e.kind==TraceEvent::INDEX_WRITE || e.kind==TraceEvent::RETURN;
+        PyObject *d = PyDict_New();
+        if (!d || !set_item(d, "step", PyLong_FromUnsignedLongLong(e.step)) || !set_item(d, "kind", py_str(trace_kind_name(e.kind)))
+            || !set_item(d, "line", PyLong_FromLong(e.line)) || !set_item(d, "pos", PyLong_FromLong(e.pos))
+            || !set_item(d, "module", py_str(e.module)) || !set_item(d, "depth", PyLong_FromUnsignedLong(e.depth))
+            || (!e.name.empty() && !set_item(d, "name", py_str(e.name)))
+            || (e.kind==TraceEvent::INDEX_WRITE && !set_item(d, "index", PyLong_FromLongLong(e.index)))
+            || (has_value && !set_item(d, "value", trace_value_to_py(e)))
+            || (has_value && e.value.is_array() && !set_item(d, "length", PyLong_FromLongLong(e.index)))) {
+            Py_XDECREF(d); Py_DECREF(list); return nullptr;
+        }
+        PyList_SET_ITEM(list, (Py_ssize_t)i, d);
+    }
+    return list;
+}
+
+static PyObject *minic_read_trace(PyObject *, PyObject *args, PyObject *kwargs) {
+    static const char *kwlist[] = {"path", "start", "count", nullptr};
+    const char *path = nullptr;
+    unsigned long long start = 0; Py_ssize_t count = 100;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|Kn:read_trace", (char **)kwlist, &path, &start, &count)) return nullptr;
+    if (count < 0) { PyErr_SetString(PyExc_ValueError, "count must not be negative"); return nullptr; }
+    string trace_path(path);
+
+    TraceReader reader; vector<TraceEvent> events; string err;
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = reader.open(trace_path, err) && reader.read(start, (size_t)count, events, err);
+    Py_END_ALLOW_THREADS
+
+    if (!ok) { PyErr_SetString(PyExc_RuntimeError, ("Failed to read trace: " + err).c_str()); return nullptr; }
+    PyObject *d = PyDict_New();
+    if (!d || !set_item(d, "first_step", PyLong_FromUnsignedLongLong(reader.first_step())) || !set_item(d, "end_step", PyLong_FromUnsignedLongLong(reader.end_step()))
+        || !set_item(d, "events", trace_events_to_py(events))) {
+        Py_XDECREF(d); return nullptr;
+    }
+    return d;
+}
+
+static PyMethodDef minic_methods[] = {
+    {"compile", (PyCFunction)(void(*)(void))minic_compile, METH_VARARGS | METH_KEYWORDS,
+     "compile(code, phases=None, emit=None, save_snapshot=None, jobs=0, import_dir=None, module_cache=None,\n"
+     "        max_steps=0, max_time_ms=0, max_depth=1000, max_output=0, max_memory=0, trace=None, trace_limit=64 MiB) -> dict\n\n"
+     "Lex, parse, check and run a MiniC program.\n"
+     "phases/emit are comma-separated lists, e.g. phases=\"sema\", emit=\"diagnostics\".\n"
+     "save_snapshot writes the checked program to a file for run_snapshot().\n"
+     "jobs limits the threads used for semantic analysis and parallel for loops (0 = all cores).\n"
+     "import_dir resolves import \"file.minic\" paths (default: current directory); module_cache\n"
+     "holds compiled module interfaces (default: <file>.mci beside each module).\n"
+     "max_steps, max_time_ms, max_depth (default 1000), max_output and max_memory (bytes of arrays)\n"
+     "limit the run; 0 disables one.\n"
+     "trace records the run to a file for read_trace(), keeping its last trace_limit bytes."},
+    {"run_snapshot", (PyCFunction)(void(*)(void))minic_run_snapshot, METH_VARARGS | METH_KEYWORDS,
+     "run_snapshot(path, emit=None, jobs=0, max_steps=0, max_time_ms=0, max_depth=1000, max_output=0, max_memory=0, trace=None, trace_limit=64 MiB) -> dict\n\n"
+     "Run a program saved with compile(..., save_snapshot=path)."},
+    {"read_trace", (PyCFunction)(void(*)(void))minic_read_trace, METH_VARARGS | METH_KEYWORDS,
+     "read_trace(path, start=0, count=100) -> dict\n\nUp to count events of a trace written by compile(..., trace=path), from step start on,\n"
+     "as {\"first_step\", \"end_step\", \"events\"}. Decodes only the blocks holding those steps."},
+    {nullptr, nullptr, 0, nullptr}
+};
+
+static struct PyModuleDef minic_module = {
+    PyModuleDef_HEAD_INIT, "minic_native", "In-process MiniC compiler backend.", -1, minic_methods,
+    nullptr, nullptr, nullptr, nullptr
+};
+
+PyMODINIT_FUNC PyInit_minic_native(void) {
+    return PyModule_Create(&minic_module);
+}
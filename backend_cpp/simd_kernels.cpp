@@ -0,0 +1,250 @@
+#include "simd_kernels.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MINIC_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+namespace simd {
+namespace {
+
+// ---- portable fallback ----------------------------------------------------
+
+template <typename T> T sum_scalar(const T *a, size_t n) { T s = 0; for (size_t i=0;i<n;++i) s += a[i]; return s; }
+template <typename T> T dot_scalar(const T *a, const T *b, size_t n) { T s = 0; for (size_t i=0;i<n;++i) s += a[i]*b[i]; return s; }
+template <typename T> void fill_scalar(T *out, size_t n, T v) { for (size_t i=0;i<n;++i) out[i] = v; }
+template <typename T> void add_scalar(const T *a, const T *b, T *out, size_t n) { for (size_t i=0;i<n;++i) out[i] = a[i]+b[i]; }
+template <typename T> void mul_scalar(const T *a, const T *b, T *out, size_t n) { for (size_t i=0;i<n;++i) out[i] = a[i]*b[i]; }
+
+#ifdef MINIC_X86
+
+// ---- SSE2 (2 x 64-bit lanes) ----------------------------------------------
+
+TARGET_SSE2 double sum_f64_sse2(const double *a, size_t n) {
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i+4<=n; i+=4) { s0 = _mm_add_pd(s0, _mm_loadu_pd(a+i)); s1 = _mm_add_pd(s1, _mm_loadu_pd(a+i+2)); }
+    double lanes[2]; _mm_storeu_pd(lanes, _mm_add_pd(s0, s1));
+    double s = lanes[0] + lanes[1];
+    for (; i<n; ++i) s += a[i];
+    return s;
+}
+
+TARGET_SSE2 int64_t sum_i64_sse2(const int64_t *a, size_t n) {
+    __m128i s = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i+2<=n; i+=2) s = _mm_add_epi64(s, _mm_loadu_si128((const __m128i*)(a+i)));
+    int64_t lanes[2]; _mm_storeu_si128((__m128i*)lanes, s);
+    int64_t r = lanes[0] + lanes[1];
+    for (; i<n; ++i) r += a[i];
+    return r;
+}
+
+TARGET_SSE2 double dot_f64_sse2(const double *a, const double *b, size_t n) {
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i+4<=n; i+=4) {
+        s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(a+i), _mm_loadu_pd(b+i)));
+        s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(a+i+2), _mm_loadu_pd(b+i+2)));
+    }
+    double lanes[2]; _mm_storeu_pd(lanes, _mm_add_pd(s0, s1));
+    double s = lanes[0] + lanes[1];
+    for (; i<n; ++i) s += a[i]*b[i];
+    return s;
+}
+
+TARGET_SSE2 void fill_f64_sse2(double *out, size_t n, double v) {
+    __m128d x = _mm_set1_pd(v);
+    size_t i = 0;
+    for (; i+2<=n; i+=2) _mm_storeu_pd(out+i, x);
+    for (; i<n; ++i) out[i] = v;
+}
+
+TARGET_SSE2 void fill_i64_sse2(int64_t *out, size_t n, int64_t v) {
+    int64_t pair[2] = {v, v};
+    __m128i x = _mm_loadu_si128((const __m128i*)pair);
+    size_t i = 0;
+    for (; i+2<=n; i+=2) _mm_storeu_si128((__m128i*)(out+i), x);
+    for (; i<n; ++i) out[i] = v;
+}
+
+TARGET_SSE2 void add_f64_sse2(const double *a, const double *b, double *out, size_t n) {
+    size_t i = 0;
+    for (; i+2<=n; i+=2) _mm_storeu_pd(out+i, _mm_add_pd(_mm_loadu_pd(a+i), _mm_loadu_pd(b+i)));
+    for (; i<n; ++i) out[i] = a[i]+b[i];
+}
+
+TARGET_SSE2 void add_i64_sse2(const int64_t *a, const int64_t *b, int64_t *out, size_t n) {
+    size_t i = 0;
+    for (; i+2<=n; i+=2) _mm_storeu_si128((__m128i*)(out+i), _mm_add_epi64(_mm_loadu_si128((const __m128i*)(a+i)), _mm_loadu_si128((const __m128i*)(b+i))));
+    for (; i<n; ++i) out[i] = a[i]+b[i];
+}
+
+TARGET_SSE2 void mul_f64_sse2(const double *a, const double *b, double *out, size_t n) {
+    size_t i = 0;
+    for (; i+2<=n; i+=2) _mm_storeu_pd(out+i, _mm_mul_pd(_mm_loadu_pd(a+i), _mm_loadu_pd(b+i)));
+    for (; i<n; ++i) out[i] = a[i]*b[i];
+}
+
+// ---- AVX2 (4 x 64-bit lanes) ----------------------------------------------
+// There is no packed 64-bit integer multiply below AVX-512, so integer
+// dot/mul stay scalar on every x86 level.
+
+TARGET_AVX2 double sum_f64_avx2(const double *a, size_t n) {
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i+8<=n; i+=8) { s0 = _mm256_add_pd(s0, _mm256_loadu_pd(a+i)); s1 = _mm256_add_pd(s1, _mm256_loadu_pd(a+i+4)); }
+    double lanes[4]; _mm256_storeu_pd(lanes, _mm256_add_pd(s0, s1));
+    double s = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i<n; ++i) s += a[i];
+    return s;
+}
+
+TARGET_AVX2 int64_t sum_i64_avx2(const int64_t *a, size_t n) {
+    __m256i s = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i+4<=n; i+=4) s = _mm256_add_epi64(s, _mm256_loadu_si256((const __m256i*)(a+i)));
+    int64_t lanes[4]; _mm256_storeu_si256((__m256i*)lanes, s);
+    int64_t r = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    for (; i<n; ++i) r += a[i];
+    return r;
+}
+
+TARGET_AVX2 double dot_f64_avx2(const double *a, const double *b, size_t n) {
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i+8<=n; i+=8) {
+        s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(a+i), _mm256_loadu_pd(b+i)));
+        s1 = _mm256_add_pd(s1, _mm256_mul_pd(_mm256_loadu_pd(a+i+4), _mm256_loadu_pd(b+i+4)));
+    }
+    double lanes[4]; _mm256_storeu_pd(lanes, _mm256_add_pd(s0, s1));
+    double s = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i<n; ++i) s += a[i]*b[i];
+    return s;
+}
+
+TARGET_AVX2 void fill_f64_avx2(double *out, size_t n, double v) {
+    __m256d x = _mm256_set1_pd(v);
+    size_t i = 0;
+    for (; i+4<=n; i+=4) _mm256_storeu_pd(out+i, x);
+    for (; i<n; ++i) out[i] = v;
+}
+
+TARGET_AVX2 void fill_i64_avx2(int64_t *out, size_t n, int64_t v) {
+    __m256i x = _mm256_set1_epi64x((long long)v);
+    size_t i = 0;
+    for (; i+4<=n; i+=4) _mm256_storeu_si256((__m256i*)(out+i), x);
+    for (; i<n; ++i) out[i] = v;
+}
+
+TARGET_AVX2 void add_f64_avx2(const double *a, const double *b, double *out, size_t n) {
+    size_t i = 0;
+    for (; i+4<=n; i+=4) _mm256_storeu_pd(out+i, _mm256_add_pd(_mm256_loadu_pd(a+i), _mm256_loadu_pd(b+i)));
+    for (; i<n; ++i) out[i] = a[i]+b[i];
+}
+
+TARGET_AVX2 void add_i64_avx2(const int64_t *a, const int64_t *b, int64_t *out, size_t n) {
+    size_t i = 0;
+    for (; i+4<=n; i+=4) _mm256_storeu_si256((__m256i*)(out+i), _mm256_add_epi64(_mm256_loadu_si256((const __m256i*)(a+i)), _mm256_loadu_si256((const __m256i*)(b+i))));
+    for (; i<n; ++i) out[i] = a[i]+b[i];
+}
+
+TARGET_AVX2 void mul_f64_avx2(const double *a, const double *b, double *out, size_t n) {
+    size_t i = 0;
+    for (; i+4<=n; i+=4) _mm256_storeu_pd(out+i, _mm256_mul_pd(_mm256_loadu_pd(a+i), _mm256_loadu_pd(b+i)));
+    for (; i<n; ++i) out[i] = a[i]*b[i];
+}
+
+bool cpu_has_sse2() {
+#if defined(__x86_64__) || defined(_M_X64)
+    return true;  // part of the x86-64 baseline
+#elif defined(_MSC_VER)
+    int r[4]; __cpuid(r, 1); return (r[3] & (1 << 26)) != 0;
+#else
+    __builtin_cpu_init(); return __builtin_cpu_supports("sse2");
+#endif
+}
+
+bool cpu_has_avx2() {
+#if defined(_MSC_VER)
+    int r[4];
+    __cpuid(r, 0); if (r[0] < 7) return false;
+    __cpuid(r, 1);
+    bool osxsave = (r[2] & (1 << 27)) != 0, avx = (r[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;  // OS must save YMM state
+    __cpuidex(r, 7, 0); return (r[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init(); return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // MINIC_X86
+
+struct Kernels {
+    const char *name;
+    double (*sum_f)(const double*, size_t);
+    int64_t (*sum_i)(const int64_t*, size_t);
+    double (*dot_f)(const double*, const double*, size_t);
+    int64_t (*dot_i)(const int64_t*, const int64_t*, size_t);
+    void (*fill_f)(double*, size_t, double);
+    void (*fill_i)(int64_t*, size_t, int64_t);
+    void (*add_f)(const double*, const double*, double*, size_t);
+    void (*add_i)(const int64_t*, const int64_t*, int64_t*, size_t);
+    void (*mul_f)(const double*, const double*, double*, size_t);
+    void (*mul_i)(const int64_t*, const int64_t*, int64_t*, size_t);
+};
+
+Kernels select_kernels() {
+    Kernels k = { "scalar", sum_scalar<double>, sum_scalar<int64_t>, dot_scalar<double>, dot_scalar<int64_t>,
+                  fill_scalar<double>, fill_scalar<int64_t>, add_scalar<double>, add_scalar<int64_t>,
+                  mul_scalar<double>, mul_scalar<int64_t> };
+#ifdef MINIC_X86
+    // MINIC_SIMD=scalar|sse2 caps the level (handy for comparing against the fallback)
+    const char *cap = getenv("MINIC_SIMD");
+    bool allow_sse2 = !cap || strcmp(cap, "scalar") != 0;
+    bool allow_avx2 = !cap || (strcmp(cap, "scalar") != 0 && strcmp(cap, "sse2") != 0);
+    if (allow_avx2 && cpu_has_avx2()) {
+        k = { "avx2", sum_f64_avx2, sum_i64_avx2, dot_f64_avx2, dot_scalar<int64_t>,
+              fill_f64_avx2, fill_i64_avx2, add_f64_avx2, add_i64_avx2, mul_f64_avx2, mul_scalar<int64_t> };
+    } else if (allow_sse2 && cpu_has_sse2()) {
+        k = { "sse2", sum_f64_sse2, sum_i64_sse2, dot_f64_sse2, dot_scalar<int64_t>,
+              fill_f64_sse2, fill_i64_sse2, add_f64_sse2, add_i64_sse2, mul_f64_sse2, mul_scalar<int64_t> };
+    }
+#endif
+    return k;
+}
+
+const Kernels &kernels() {
+    static const Kernels k = select_kernels();
+    return k;
+}
+
+} // namespace
+
+double sum(const double *a, size_t n) { return kernels().sum_f(a, n); }
+int64_t sum(const int64_t *a, size_t n) { return kernels().sum_i(a, n); }
+double dot(const double *a, const double *b, size_t n) { return kernels().dot_f(a, b, n); }
+int64_t dot(const int64_t *a, const int64_t *b, size_t n) { return kernels().dot_i(a, b, n); }
+void fill(double *out, size_t n, double v) { kernels().fill_f(out, n, v); }
+void fill(int64_t *out, size_t n, int64_t v) { kernels().fill_i(out, n, v); }
+void add(const double *a, const double *b, double *out, size_t n) { kernels().add_f(a, b, out, n); }
+void add(const int64_t *a, const int64_t *b, int64_t *out, size_t n) { kernels().add_i(a, b, out, n); }
+void mul(const double *a, const double *b, double *out, size_t n) { kernels().mul_f(a, b, out, n); }
+void mul(const int64_t *a, const int64_t *b, int64_t *out, size_t n) { kernels().mul_i(a, b, out, n); }
+const char *active_isa() { return kernels().name; }
+
+} // namespace simd
@@ -0,0 +1,29 @@
+// Vector kernels behind the MiniC array builtins. The implementation is picked
+// once per process from the CPU's features (AVX2, then SSE2, then portable
+// scalar code). Setting MINIC_SIMD=sse2 or MINIC_SIMD=scalar in the environment
+// caps the level. Internal to minic_core.
+//
+// Float reductions (sum, dot) add in lane order, so their last bits can
+// differ from a strictly left-to-right loop and between instruction sets.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace simd {
+
+double sum(const double *a, size_t n);
+int64_t sum(const int64_t *a, size_t n);
+double dot(const double *a, const double *b, size_t n);
+int64_t dot(const int64_t *a, const int64_t *b, size_t n);
+void fill(double *out, size_t n, double v);
+void fill(int64_t *out, size_t n, int64_t v);
+void add(const double *a, const double *b, double *out, size_t n);
+void add(const int64_t *a, const int64_t *b, int64_t *out, size_t n);
+void mul(const double *a, const double *b, double *out, size_t n);
+void mul(const int64_t *a, const int64_t *b, int64_t *out, size_t n);
+
+// "avx2", "sse2" or "scalar"
+const char *active_isa();
+
+} // namespace simd
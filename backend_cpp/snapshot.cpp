@@ -0,0 +1,326 @@
+#include "snapshot.h"
+#include "file_util.h"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+
+using namespace std;
+
+// Snapshot file layout (native byte order, every section 8-byte aligned so
+// records are read in place from the loaded file):
+//
+//   SnapshotHeader
+//   string offsets  u32[string_count + 1]  into the string bytes
+//   string bytes
+//   nodes           NodeRec[node_count]    preorder, node 0 is the Program
+//   child ids       u32[child_total]       NO_NODE for a null child
+//   globals         NamedRec[global_count] declaration order
+//   values          ValueRec[value_count]  declaration order, then implicit globals by name
+//   array data      u64[element_total]     elements of array values, raw bits
+//   functions       FunctionRec[function_count] declaration order
+//   params          NamedRec[param_total]
+//   warnings        u32[warning_count]     string ids
+//   imports         ImportRec[import_count] module interfaces only
+//
+// Bump SNAPSHOT_VERSION whenever any of the records below change.
+
+static const char SNAPSHOT_MAGIC[8] = {'M','I','N','I','C','S','N','P'};
+static const uint32_t SNAPSHOT_VERSION = 5;
+static const uint32_t ENDIAN_TAG = 0x01020304;
+static const uint32_t NO_NODE = 0xFFFFFFFFu;
+
+enum Section { SEC_STR_OFFSETS, SEC_STR_BYTES, SEC_NODES, SEC_CHILDREN, SEC_GLOBALS, SEC_VALUES, SEC_ARRAY_DATA, SEC_FUNCTIONS, SEC_PARAMS, SEC_WARNINGS, SEC_IMPORTS, SEC_COUNT };
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian_tag;
+    uint64_t offset[SEC_COUNT];
+    uint32_t count[SEC_COUNT];   // elements (bytes for SEC_STR_BYTES)
+    uint32_t output;             // string id of output produced by initializers
+    uint64_t source_hash;        // module interfaces: hash of the module source
+};
+
+struct NodeRec { uint32_t type, value, first_child, child_count; int32_t line, pos; };
+struct NamedRec { uint32_t name, type; };
+// For arrays, i is the first element's index in the array data section and
+// length the element count.
+struct ValueRec { int64_t i; double f; uint32_t name, type, b, length; };
+struct FunctionRec { uint32_t name, return_type, body, first_param, param_count, module; };
+struct ImportRec { uint64_t hash; uint32_t path, pad; };
+
+namespace {
+
+struct SnapshotWriter {
+    vector<string> strings;
+    unordered_map<string, uint32_t> string_ids;
+    vector<NodeRec> nodes;
+    vector<uint32_t> children;
+    unordered_map<const AST*, uint32_t> node_ids;
+
+    uint32_t intern(const string &s) {
+        auto it = string_ids.find(s);
+        if (it != string_ids.end()) return it->second;
+        uint32_t id = (uint32_t)strings.size();
+        strings.push_back(s); string_ids.emplace(s, id);
+        return id;
+    }
+
+    uint32_t add_node(const shared_ptr<AST> &node) {
+        if (!node) return NO_NODE;
+        auto it = node_ids.find(node.get());
+        if (it != node_ids.end()) return it->second;
+        uint32_t id = (uint32_t)nodes.size();
+        node_ids.emplace(node.get(), id);
+        nodes.push_back({intern(node->node_type), intern(node->value), 0, (uint32_t)node->children.size(), node->line, node->pos});
+        vector<uint32_t> ids;
+        for (auto &c : node->children) ids.push_back(add_node(c));
+        nodes[id].first_child = (uint32_t)children.size();
+        children.insert(children.end(), ids.begin(), ids.end());
+        return id;
+    }
+};
+
+// The whole file, in 8-byte aligned memory so records are read in place
+bool read_snapshot_file(const string &path, vector<uint64_t> &buf, size_t &size, string &err) {
+    error_code ec;
+    if (!filesystem::is_regular_file(path, ec)) { err = "cannot open '" + path + "'"; return false; }
+    uintmax_t n = filesystem::file_size(path, ec);
+    if (ec) { err = "cannot stat '" + path + "'"; return false; }
+    if (n < sizeof(SnapshotHeader)) { err = "file too small"; return false; }
+    if (n > SIZE_MAX - 8) { err = "file too large"; return false; }
+    ifstream in(path, ios::binary);
+    size = (size_t)n;
+    buf.resize((size + 7) / 8);
+    if (!in.read((char*)buf.data(), (streamsize)size)) { err = "cannot read '" + path + "'"; return false; }
+    return true;
+}
+
+bool is_type_node(const shared_ptr<AST> &n, bool arrays) {
+    if (!n || !n->children.empty()) return false;
+    const string &t = n->node_type;
+    return t=="int" || t=="float" || t=="bool" || (arrays && (t=="int[]" || t=="float[]"));
+}
+bool is_scalar_type(const string &t) { return t=="int" || t=="float" || t=="bool"; }
+
+// Whether a node has the children the parser gives its type. Only operands
+// the parser could not read are ever null.
+bool valid_shape(const AST &n) {
+    const string &t = n.node_type;
+    const auto &c = n.children;
+    size_t k = c.size();
+    auto count = [&](size_t lo, size_t hi) {
+        if (k < lo || k > hi) return false;
+        for (auto &x : c) if (!x) return false;
+        return true;
+    };
+    auto block = [&](size_t i) { return c[i]->node_type=="Block"; };
+    if (t=="Program" || t=="Block" || t=="Call") return count(0, SIZE_MAX);
+    if (t=="Import" || t=="Literal" || t=="Identifier" || is_scalar_type(t) || t=="int[]" || t=="float[]") return k==0;
+    if (t=="VarDecl") return count(1, 2) && is_type_node(c[0], true);
+    if (t=="FunctionDecl") return count(3, 3) && c[0]->node_type=="Params" && is_type_node(c[1], false) && block(2);
+    if (t=="Params") { for (auto &p : c) if (!p || p->node_type!="Param") return false; return true; }
+    if (t=="Param") return k==1 && is_type_node(c[0], false);
+    if (t=="If") return count(2, 3) && block(1) && (k==2 || block(2));
+    if (t=="While") return count(2, 2) && block(1);
+    if (t=="For") return count(1, 4) && block(k-1);
+    if (t=="ParallelFor") return count(4, 5) && block(k-1) && (k==4 || c[3]->node_type=="Reduction");
+    if (t=="Reduction") return count(1, 1) && c[0]->node_type=="Identifier";
+    if (t=="Return") return count(0, 1);
+    if (t=="Print" || t=="Index") return count(1, 1);
+    if (t=="IndexAssign") return count(2, 2);
+    if (t=="Assign" || t=="UnaryOp") return k==1;
+    if (t=="BinaryOp") return k==2;
+    return false;
+}
+
+void pad_to_8(string &buf) { while (buf.size() % 8) buf.push_back('\0'); }
+
+template <typename T>
+void append_section(string &buf, SnapshotHeader &h, Section sec, const vector<T> &items) {
+    pad_to_8(buf);
+    h.offset[sec] = buf.size();
+    h.count[sec] = (uint32_t)items.size();
+    if (!items.empty()) buf.append((const char*)items.data(), items.size() * sizeof(T));
+}
+
+} // namespace
+
+bool save_snapshot(const string &path, const ProgramImage &img, string &err) {
+    SnapshotWriter w;
+    uint32_t root = w.add_node(img.ast);
+    if (root != 0) { err = "program has no AST"; return false; }
+
+    vector<NamedRec> globals;
+    for (auto &g : img.globals) globals.push_back({w.intern(g.first), (uint32_t)g.second});
+    vector<ValueRec> values; vector<uint64_t> array_data;
+    for (auto &v : img.global_values) {
+        const Value &val = v.second;
+        ValueRec rec = {val.i, val.f, w.intern(v.first), (uint32_t)val.type, val.b ? 1u : 0u, 0};
+        if (val.is_array()) {
+            rec.i = (int64_t)array_data.size(); rec.length = (uint32_t)val.length();
+            size_t at = array_data.size();
+            array_data.resize(at + val.length());
+            if (val.length()) memcpy(&array_data[at], val.type==Value::INT_ARRAY ? (const void*)val.arr->ints.data() : (const void*)val.arr->floats.data(), val.length() * 8);
+        }
+        values.push_back(rec);
+    }
+    vector<FunctionRec> functions; vector<NamedRec> params;
+    for (auto &fi : img.functions) {
+        uint32_t body = w.add_node(fi.body);
+        functions.push_back({w.intern(fi.name), w.intern(fi.return_type), body, (uint32_t)params.size(), (uint32_t)fi.params.size(), w.intern(fi.module)});
+        for (auto &p : fi.params) params.push_back({w.intern(p.first), w.intern(p.second)});
+    }
+    vector<uint32_t> warnings;
+    for (auto &s : img.warnings) warnings.push_back(w.intern(s));
+    vector<ImportRec> imports;
+    for (auto &imp : img.imports) imports.push_back({imp.second, w.intern(imp.first), 0});
+    uint32_t output = w.intern(img.output);
+
+    // string table last, once every string has been interned
+    vector<uint32_t> str_offsets; string str_bytes;
+    for (auto &s : w.strings) { str_offsets.push_back((uint32_t)str_bytes.size()); str_bytes += s; }
+    str_offsets.push_back((uint32_t)str_bytes.size());
+
+    SnapshotHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+    h.version = SNAPSHOT_VERSION;
+    h.endian_tag = ENDIAN_TAG;
+    h.output = output;
+    h.source_hash = img.source_hash;
+
+    string buf(sizeof(SnapshotHeader), '\0');
+    append_section(buf, h, SEC_STR_OFFSETS, str_offsets);
+    pad_to_8(buf);
+    h.offset[SEC_STR_BYTES] = buf.size(); h.count[SEC_STR_BYTES] = (uint32_t)str_bytes.size(); buf += str_bytes;
+    append_section(buf, h, SEC_NODES, w.nodes);
+    append_section(buf, h, SEC_CHILDREN, w.children);
+    append_section(buf, h, SEC_GLOBALS, globals);
+    append_section(buf, h, SEC_VALUES, values);
+    append_section(buf, h, SEC_ARRAY_DATA, array_data);
+    append_section(buf, h, SEC_FUNCTIONS, functions);
+    append_section(buf, h, SEC_PARAMS, params);
+    append_section(buf, h, SEC_WARNINGS, warnings);
+    append_section(buf, h, SEC_IMPORTS, imports);
+    memcpy(&buf[0], &h, sizeof(h));
+
+    // module interfaces are shared between compiles, so never expose a partial file
+    return write_file_atomic(path, buf, err);
+}
+
+bool load_snapshot(const string &path, ProgramImage &img, string &err) {
+    vector<uint64_t> file; size_t size = 0;
+    if (!read_snapshot_file(path, file, size, err)) return false;
+    const unsigned char *data = (const unsigned char*)file.data();
+    SnapshotHeader h;
+    memcpy(&h, data, sizeof(h));
+    if (memcmp(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic)) != 0) { err = "not a MiniC snapshot"; return false; }
+    if (h.endian_tag != ENDIAN_TAG) { err = "snapshot was written on a machine with different byte order"; return false; }
+    if (h.version != SNAPSHOT_VERSION) { err = "unsupported snapshot version " + to_string(h.version); return false; }
+
+    static const size_t elem_size[SEC_COUNT] = {
+        sizeof(uint32_t), 1, sizeof(NodeRec), sizeof(uint32_t), sizeof(NamedRec),
+        sizeof(ValueRec), sizeof(uint64_t), sizeof(FunctionRec), sizeof(NamedRec), sizeof(uint32_t),
+        sizeof(ImportRec)
+    };
+    for (int s=0;s<SEC_COUNT;++s) {
+        if (h.offset[s] % 8 || h.offset[s] > size || (size - h.offset[s]) / elem_size[s] < h.count[s]) { err = "truncated or corrupt snapshot"; return false; }
+    }
+    auto section = [&](Section s) { return data + h.offset[s]; };
+    const uint32_t *str_offsets = (const uint32_t*)section(SEC_STR_OFFSETS);
+    const char *str_bytes = (const char*)section(SEC_STR_BYTES);
+    uint32_t string_count = h.count[SEC_STR_OFFSETS] ? h.count[SEC_STR_OFFSETS] - 1 : 0;
+    for (uint32_t i=0;i<string_count;++i) {
+        if (str_offsets[i] > str_offsets[i+1] || str_offsets[i+1] > h.count[SEC_STR_BYTES]) { err = "corrupt string table"; return false; }
+    }
+    bool bad = false;
+    auto str = [&](uint32_t id) -> string {
+        if (id >= string_count) { bad = true; return string(); }
+        return string(str_bytes + str_offsets[id], str_offsets[id+1] - str_offsets[id]);
+    };
+
+    const NodeRec *node_recs = (const NodeRec*)section(SEC_NODES);
+    const uint32_t *child_ids = (const uint32_t*)section(SEC_CHILDREN);
+    uint32_t node_count = h.count[SEC_NODES];
+    if (node_count == 0) { err = "snapshot has no program"; return false; }
+    vector<shared_ptr<AST>> nodes(node_count);
+    for (uint32_t n=0;n<node_count;++n) {
+        nodes[n] = make_shared<AST>(str(node_recs[n].type));
+        nodes[n]->value = str(node_recs[n].value);
+        nodes[n]->line = node_recs[n].line; nodes[n]->pos = node_recs[n].pos;
+    }
+    // every node is walked recursively and analyzed in one place, so each
+    // has at most one parent and a bounded depth
+    vector<uint32_t> parent(node_count, NO_NODE);
+    vector<int> depth(node_count, 0);
+    for (uint32_t n=0;n<node_count && !bad;++n) {
+        const NodeRec &rec = node_recs[n];
+        if (rec.first_child > h.count[SEC_CHILDREN] || h.count[SEC_CHILDREN] - rec.first_child < rec.child_count) { bad = true; break; }
+        auto &kids = nodes[n]->children;
+        kids.reserve(rec.child_count);
+        for (uint32_t c=0;c<rec.child_count;++c) {
+            uint32_t id = child_ids[rec.first_child + c];
+            // preorder: children always follow their parent, which also rules
+            // out cycles and settles a node's depth before its children's
+            if (id == NO_NODE) { kids.push_back(nullptr); continue; }
+            if (id <= n || id >= node_count || parent[id] != NO_NODE) { bad = true; break; }
+            parent[id] = n; depth[id] = depth[n] + 1;
+            if (depth[id] > MAX_AST_DEPTH) { bad = true; break; }
+            kids.push_back(nodes[id]);
+        }
+        if (!bad && !valid_shape(*nodes[n])) bad = true;
+    }
+    if (bad || nodes[0]->node_type!="Program") { err = "corrupt AST section"; return false; }
+    img.ast = nodes[0];
+
+    const NamedRec *globals = (const NamedRec*)section(SEC_GLOBALS);
+    for (uint32_t g=0;g<h.count[SEC_GLOBALS];++g) {
+        if (globals[g].type > Value::FLOAT_ARRAY) { err = "corrupt globals section"; return false; }
+        img.globals.push_back({str(globals[g].name), (Value::Type)globals[g].type});
+    }
+    const ValueRec *values = (const ValueRec*)section(SEC_VALUES);
+    const uint64_t *array_data = (const uint64_t*)section(SEC_ARRAY_DATA);
+    unordered_map<uint32_t, bool> seen_value;
+    for (uint32_t v=0;v<h.count[SEC_VALUES];++v) {
+        if (values[v].type > Value::FLOAT_ARRAY || seen_value[values[v].name]) { err = "corrupt values section"; return false; }
+        seen_value[values[v].name] = true;
+        Value val; val.type = (Value::Type)values[v].type; val.i = values[v].i; val.f = values[v].f; val.b = values[v].b != 0;
+        if (val.is_array()) {
+            uint64_t first = (uint64_t)values[v].i, n = values[v].length;
+            if (first > h.count[SEC_ARRAY_DATA] || h.count[SEC_ARRAY_DATA] - first < n) { err = "corrupt array data section"; return false; }
+            val.i = 0; val.arr = make_shared<ArrayData>();
+            if (val.type==Value::INT_ARRAY) { val.arr->ints.resize(n); if (n) memcpy(val.arr->ints.data(), array_data + first, n * 8); }
+            else { val.arr->floats.resize(n); if (n) memcpy(val.arr->floats.data(), array_data + first, n * 8); }
+        }
+        img.global_values.push_back({str(values[v].name), val});
+    }
+    const FunctionRec *functions = (const FunctionRec*)section(SEC_FUNCTIONS);
+    const NamedRec *params = (const NamedRec*)section(SEC_PARAMS);
+    vector<bool> is_body(node_count, false);
+    for (uint32_t fn=0;fn<h.count[SEC_FUNCTIONS];++fn) {
+        const FunctionRec &rec = functions[fn];
+        if (rec.body >= node_count || is_body[rec.body] || rec.first_param > h.count[SEC_PARAMS] || h.count[SEC_PARAMS] - rec.first_param < rec.param_count) { err = "corrupt function table"; return false; }
+        is_body[rec.body] = true;
+        FunctionInfo fi; fi.name = str(rec.name); fi.return_type = str(rec.return_type); fi.body = nodes[rec.body]; fi.module = str(rec.module);
+        for (uint32_t p=0;p<rec.param_count;++p) fi.params.push_back({str(params[rec.first_param+p].name), str(params[rec.first_param+p].type)});
+        // a body is a tree of its own (imported functions) or its declaration's
+        uint32_t decl = parent[rec.body];
+        bool own = decl == NO_NODE ? fi.body->node_type=="Block" : nodes[decl]->node_type=="FunctionDecl" && nodes[decl]->children[2]==fi.body && nodes[decl]->value==fi.name;
+        bool typed = is_scalar_type(fi.return_type);
+        for (auto &p : fi.params) typed = typed && is_scalar_type(p.second);
+        if (!own || !typed) { err = "corrupt function table"; return false; }
+        img.functions.push_back(move(fi));
+    }
+    const uint32_t *warnings = (const uint32_t*)section(SEC_WARNINGS);
+    for (uint32_t w=0;w<h.count[SEC_WARNINGS];++w) img.warnings.push_back(str(warnings[w]));
+    const ImportRec *imports = (const ImportRec*)section(SEC_IMPORTS);
+    for (uint32_t i=0;i<h.count[SEC_IMPORTS];++i) img.imports.push_back({str(imports[i].path), imports[i].hash});
+    img.output = str(h.output);
+    img.source_hash = h.source_hash;
+    if (bad) { err = "corrupt string reference"; return false; }
+    return true;
+}
@@ -0,0 +1,31 @@
+// Binary snapshots of a checked MiniC program (see snapshot.cpp for the
+// on-disk layout). The same format stores compiled module interfaces.
+// Internal to minic_core.
+#pragma once
+
+#include "minic.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// State of a program after its global initializers ran, just before its
+// top-level statements run. Tables are kept in declaration order so a loaded
+// program rebuilds its hash maps exactly as the front end did. Analysis
+// results are not stored: load_snapshot() only checks that the AST has the
+// shapes the parser builds, and the caller analyzes it again.
+struct ProgramImage {
+    std::shared_ptr<AST> ast;
+    std::vector<std::pair<std::string, Value::Type>> globals;
+    std::vector<std::pair<std::string, Value>> global_values;
+    std::vector<FunctionInfo> functions;
+    std::vector<std::string> warnings;
+    std::string output;
+    // Module interfaces only: hash of the module source, and the resolved
+    // path and source hash of every module it imported when compiled.
+    uint64_t source_hash = 0;
+    std::vector<std::pair<std::string, uint64_t>> imports;
+};
+
+bool save_snapshot(const std::string &path, const ProgramImage &img, std::string &err);
+bool load_snapshot(const std::string &path, ProgramImage &img, std::string &err);
@@ -0,0 +1,202 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+// std::thread cannot choose its stack size, so threads are started natively
+#ifdef _WIN32
+unsigned __stdcall thread_main(void *arg) {
+    unique_ptr<function<void()>> fn((function<void()>*)arg);
+    (*fn)();
+    return 0;
+}
+#else
+void *thread_main(void *arg) {
+    unique_ptr<function<void()>> fn((function<void()>*)arg);
+    (*fn)();
+    return nullptr;
+}
+#endif
+
+// Starts fn on a thread with a STACK_BYTES stack, then waits for it to
+// finish (join) or lets it run on its own
+void start_thread(function<void()> fn, bool join) {
+    auto *arg = new function<void()>(move(fn));
+#ifdef _WIN32
+    HANDLE h = (HANDLE)_beginthreadex(nullptr, (unsigned)STACK_BYTES, thread_main, arg, STACK_SIZE_PARAM_IS_A_RESERVATION, nullptr);
+    if (!h) { delete arg; throw system_error(errno, generic_category(), "_beginthreadex"); }
+    if (join) WaitForSingleObject(h, INFINITE);
+    CloseHandle(h);
+#else
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, STACK_BYTES);
+    pthread_t t;
+    int rc = pthread_create(&t, &attr, thread_main, arg);
+    pthread_attr_destroy(&attr);
+    if (rc) { delete arg; throw system_error(rc, generic_category(), "pthread_create"); }
+    if (join) pthread_join(t, nullptr); else pthread_detach(t);
+#endif
+}
+
+// Remaining indices of one participant's share, [begin, end).
+struct Range {
+    mutex m;
+    size_t begin = 0, end = 0;
+};
+
+struct Job {
+    const function<void(size_t, unsigned)> *body = nullptr;
+    size_t n = 0;
+    unsigned slots = 0;
+    unique_ptr<Range[]> ranges;
+    atomic<unsigned> next_slot{1};   // slot 0 belongs to the caller
+    atomic<size_t> finished{0};      // indices run (or skipped after a failure)
+    atomic<bool> failed{false};
+    exception_ptr error;
+    mutex m;
+    condition_variable cv;
+};
+
+bool take_index(Job &job, unsigned slot, size_t &out) {
+    Range &own = job.ranges[slot];
+    {
+        lock_guard<mutex> lk(own.m);
+        if (own.begin < own.end) { out = own.begin++; return true; }
+    }
+    for (unsigned k=1;k<job.slots;++k) {
+        Range &victim = job.ranges[(slot + k) % job.slots];
+        size_t b, e;
+        {
+            lock_guard<mutex> lk(victim.m);
+            size_t remaining = victim.end - victim.begin;
+            if (!remaining) continue;
+            size_t stolen = (remaining + 1) / 2;
+            e = victim.end; b = e - stolen; victim.end = b;
+        }
+        lock_guard<mutex> lk(own.m);
+        own.begin = b + 1; own.end = e;
+        out = b;
+        return true;
+    }
+    return false;
+}
+
+void participate(Job &job, unsigned slot) {
+    size_t i;
+    while (take_index(job, slot, i)) {
+        if (!job.failed.load(memory_order_relaxed)) {
+            try { (*job.body)(i, slot); }
+            catch (...) {
+                lock_guard<mutex> lk(job.m);
+                if (!job.error) job.error = current_exception();
+                job.failed = true;
+            }
+        }
+        if (job.finished.fetch_add(1) + 1 == job.n) {
+            lock_guard<mutex> lk(job.m);
+            job.cv.notify_all();
+        }
+    }
+}
+
+} // namespace
+
+struct ThreadPool::Impl {
+    mutex m;
+    condition_variable cv;
+    deque<shared_ptr<Job>> queue;
+    unsigned workers = 0;
+
+    void worker_loop() {
+        for (;;) {
+            shared_ptr<Job> job; unsigned slot;
+            {
+                unique_lock<mutex> lk(m);
+                cv.wait(lk, [&]{ return !queue.empty(); });
+                job = queue.front();
+                slot = job->next_slot++;
+                if (slot >= job->slots) { queue.pop_front(); continue; }
+            }
+            participate(*job, slot);
+        }
+    }
+};
+
+ThreadPool::ThreadPool(unsigned workers): impl(new Impl) {
+    // workers live for the whole process; never joined
+    for (unsigned w=0;w<workers;++w) start_thread([this]{ impl->worker_loop(); }, false);
+    impl->workers = workers;
+}
+
+ThreadPool &ThreadPool::shared() {
+    // intentionally leaked so no worker is torn down during static destruction
+    static ThreadPool *pool = new ThreadPool(max(1u, thread::hardware_concurrency()) - 1);
+    return *pool;
+}
+
+unsigned ThreadPool::max_parallelism() const {
+    return impl->workers + 1;
+}
+
+void ThreadPool::parallel_for(size_t n, unsigned jobs, const function<void(size_t, unsigned)> &body) {
+    if (n == 0) return;
+    unsigned slots = (unsigned)min<size_t>(min(max(jobs, 1u), max_parallelism()), n);
+    if (slots == 1) {
+        for (size_t i=0;i<n;++i) body(i, 0);
+        return;
+    }
+
+    auto job = make_shared<Job>();
+    job->body = &body; job->n = n; job->slots = slots;
+    job->ranges.reset(new Range[slots]);
+    for (unsigned s=0;s<slots;++s) { job->ranges[s].begin = n * s / slots; job->ranges[s].end = n * (s + 1) / slots; }
+    {
+        lock_guard<mutex> lk(impl->m);
+        impl->queue.push_back(job);
+    }
+    impl->cv.notify_all();
+
+    participate(*job, 0);
+    {
+        unique_lock<mutex> lk(job->m);
+        job->cv.wait(lk, [&]{ return job->finished.load() == job->n; });
+    }
+    {
+        lock_guard<mutex> lk(impl->m);
+        auto it = find(impl->queue.begin(), impl->queue.end(), job);
+        if (it != impl->queue.end()) impl->queue.erase(it);
+    }
+    if (job->error) rethrow_exception(job->error);
+}
+
+unsigned effective_jobs(unsigned requested) {
+    unsigned available = ThreadPool::shared().max_parallelism();
+    return requested == 0 ? available : min(requested, available);
+}
+
+void run_with_stack(const function<void()> &fn) {
+    exception_ptr error;
+    start_thread([&]{ try { fn(); } catch (...) { error = current_exception(); } }, true);
+    if (error) rethrow_exception(error);
+}
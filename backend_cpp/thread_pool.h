@@ -0,0 +1,41 @@
+// Shared work-stealing thread pool used by the semantic analyzer and the
+// interpreter. Internal to minic_core.
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+class ThreadPool {
+public:
+    // Process-wide pool with hardware_concurrency()-1 workers, created on first use.
+    static ThreadPool &shared();
+
+    // Number of threads a job may use: the workers plus the calling thread.
+    unsigned max_parallelism() const;
+
+    // Runs body(i, slot) for every i in [0, n) and returns once all calls have
+    // finished. At most `jobs` threads take part, the caller included; `slot`
+    // identifies the participant (0 .. jobs-1), so callers can keep per-thread
+    // scratch state indexed by it. Each participant starts on a contiguous
+    // share of the index range and steals half of a busy participant's
+    // remainder once its own share runs out. The first exception thrown by
+    // body is rethrown here after all participants have stopped.
+    void parallel_for(size_t n, unsigned jobs, const std::function<void(size_t, unsigned)> &body);
+
+private:
+    ThreadPool(unsigned workers);
+    struct Impl;
+    Impl *impl;
+};
+
+// Resolve a user-facing job count: 0 means "all available threads".
+unsigned effective_jobs(unsigned requested);
+
+// Native stack of the pool's workers and of run_with_stack(). The interpreter
+// recurses as deep as a program nests, up to Interpreter::MAX_NESTING frames;
+// only the pages actually used are committed.
+const size_t STACK_BYTES = (size_t)128 << 20;
+
+// Runs fn on a new thread with a STACK_BYTES stack and waits for it. An
+// exception thrown by fn is rethrown here.
+void run_with_stack(const std::function<void()> &fn);
@@ -0,0 +1,337 @@
+#include "trace.h"
+#include "file_util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+// Trace file layout (native byte order):
+//
+//   TraceHeader
+//   string offsets  u32[string_count + 1]  into the string bytes
+//   string bytes
+//   index           TraceRecorder::Key[block_count], 8-byte aligned, by first_step
+//   block bytes     events; a block's offset and size are in its index entry
+//
+// An event is a header byte, kind in bits 0-2, value tag in bits 3-5 and
+// MODULE_CHANGED in bit 6, followed by varints:
+//   STATEMENT    [module] zigzag(line delta) zigzag(pos delta)
+//   CALL         [module] name zigzag(line delta) zigzag(pos delta)
+//   WRITE        name value
+//   INDEX_WRITE  name zigzag(index) value
+//   RETURN       [module] zigzag(line delta) zigzag(pos delta) value
+// where a value is zigzag(int), 8 raw bytes (float), the array length, or
+// nothing (bool and none live in the tag).
+
+static const char TRACE_MAGIC[8] = {'M','I','N','I','C','T','R','C'};
+static const uint32_t TRACE_VERSION = 1;
+static const uint32_t ENDIAN_TAG = 0x01020304;
+
+struct TraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian_tag;
+    uint64_t first_step, end_step;
+    uint32_t string_count, block_count;
+    uint64_t index_offset;
+};
+
+namespace {
+
+enum Tag { TAG_NONE, TAG_INT, TAG_FLOAT, TAG_FALSE, TAG_TRUE, TAG_INT_ARRAY, TAG_FLOAT_ARRAY };
+const uint8_t MODULE_CHANGED = 0x40;
+
+inline uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+inline int64_t unzigzag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+inline void put_varint(uint8_t *&p, uint64_t v) {
+    while (v >= 0x80) { *p++ = (uint8_t)(v | 0x80); v >>= 7; }
+    *p++ = (uint8_t)v;
+}
+
+inline uint8_t value_tag(const Value &v) {
+    switch (v.type) {
+        case Value::INT: return TAG_INT;
+        case Value::FLOAT: return TAG_FLOAT;
+        case Value::BOOL: return v.b ? TAG_TRUE : TAG_FALSE;
+        case Value::INT_ARRAY: return TAG_INT_ARRAY;
+        case Value::FLOAT_ARRAY: return TAG_FLOAT_ARRAY;
+        default: return TAG_NONE;
+    }
+}
+
+inline void put_value(uint8_t *&p, uint8_t tag, const Value &v) {
+    if (tag==TAG_INT) put_varint(p, zigzag(v.i));
+    else if (tag==TAG_FLOAT) { memcpy(p, &v.f, 8); p += 8; }
+    else if (tag==TAG_INT_ARRAY || tag==TAG_FLOAT_ARRAY) put_varint(p, v.length());
+}
+
+// Bounds-checked reads for the decoder; `ok` turns false past the end
+struct Cursor {
+    const uint8_t *p, *end;
+    bool ok = true;
+    uint64_t varint() {
+        uint64_t v = 0;
+        for (int shift=0; shift<64; shift+=7) {
+            if (p >= end) { ok = false; return 0; }
+            uint8_t b = *p++;
+            v |= (uint64_t)(b & 0x7f) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        ok = false; return 0;
+    }
+    int64_t svarint() { return unzigzag(varint()); }
+    double f64() {
+        double d = 0;
+        if (end - p < 8) { ok = false; return d; }
+        memcpy(&d, p, 8); p += 8; return d;
+    }
+};
+
+} // namespace
+
+const char *trace_kind_name(TraceEvent::Kind k) {
+    static const char *names[] = {"statement", "write", "index_write", "call", "return"};
+    return names[k];
+}
+
+TraceRecorder::TraceRecorder(size_t limit_bytes) {
+    // at least 16 blocks, so dropping one loses a small share of the trace
+    limit = max<size_t>(limit_bytes, 16 * 1024);
+    block_size = min<size_t>(limit / 16, 64 * 1024);
+    open.bytes.resize(block_size);
+    open.key = Key{0, 0, 0, 0, 0, 0, 0, 0};
+    intern("");  // module 0: the main program
+}
+
+uint32_t TraceRecorder::intern(const string &s) {
+    auto it = string_ids.find(s);
+    if (it != string_ids.end()) return it->second;
+    uint32_t id = (uint32_t)strings.size();
+    strings.push_back(s);
+    string_ids.emplace(s, id);
+    return id;
+}
+
+void TraceRecorder::position(uint8_t *&p, int new_line, int new_pos) {
+    put_varint(p, zigzag((int64_t)new_line - line));
+    put_varint(p, zigzag((int64_t)new_pos - pos));
+    line = new_line; pos = new_pos;
+}
+
+void TraceRecorder::statement(int l, int ps, uint32_t m) {
+    uint8_t *p = begin_event(TraceEvent::STATEMENT | (m != module ? MODULE_CHANGED : 0));
+    if (m != module) { put_varint(p, m); module = m; }
+    position(p, l, ps);
+    end_event(p);
+}
+
+void TraceRecorder::call(uint32_t name, int l, int ps, uint32_t m) {
+    uint8_t *p = begin_event(TraceEvent::CALL | (m != module ? MODULE_CHANGED : 0));
+    if (m != module) { put_varint(p, m); module = m; }
+    put_varint(p, name);
+    position(p, l, ps);
+    ++depth;
+    end_event(p);
+}
+
+void TraceRecorder::ret(const Value &v, int l, int ps, uint32_t m) {
+    uint8_t tag = value_tag(v);
+    uint8_t *p = begin_event(TraceEvent::RETURN | tag << 3 | (m != module ? MODULE_CHANGED : 0));
+    if (m != module) { put_varint(p, m); module = m; }
+    position(p, l, ps);
+    put_value(p, tag, v);
+    if (depth) --depth;
+    end_event(p);
+}
+
+void TraceRecorder::write(uint32_t name, const Value &v) {
+    uint8_t tag = value_tag(v);
+    uint8_t *p = begin_event(TraceEvent::WRITE | tag << 3);
+    put_varint(p, name);
+    put_value(p, tag, v);
+    end_event(p);
+}
+
+void TraceRecorder::index_write(uint32_t name, long long index, const Value &v) {
+    uint8_t tag = value_tag(v);
+    uint8_t *p = begin_event(TraceEvent::INDEX_WRITE | tag << 3);
+    put_varint(p, name);
+    put_varint(p, zigzag(index));
+    put_value(p, tag, v);
+    end_event(p);
+}
+
+// Close the open block and start the next one from the current state,
+// dropping the oldest blocks while the ring is over its limit.
+void TraceRecorder::seal() {
+    open.key.size = (uint32_t)used;
+    open.bytes.resize(used);
+    sealed_bytes += used;
+    sealed.push_back(move(open));
+    vector<uint8_t> spare;
+    while (!sealed.empty() && sealed_bytes + block_size > limit) {
+        sealed_bytes -= sealed.front().bytes.size();
+        spare = move(sealed.front().bytes);
+        sealed.pop_front();
+    }
+    open.bytes = move(spare);
+    open.bytes.resize(block_size);
+    open.key = Key{step, 0, 0, 0, line, pos, depth, module};
+    used = 0;
+}
+
+bool TraceRecorder::save(const string &path, string &err) {
+    vector<Key> index;
+    for (auto &b : sealed) index.push_back(b.key);
+    Key last = open.key; last.size = (uint32_t)used;
+    if (last.events) index.push_back(last);
+
+    TraceHeader h;
+    memcpy(h.magic, TRACE_MAGIC, sizeof(h.magic));
+    h.version = TRACE_VERSION;
+    h.endian_tag = ENDIAN_TAG;
+    h.first_step = index.empty() ? step : index[0].first_step;
+    h.end_step = step;
+    h.string_count = (uint32_t)strings.size();
+    h.block_count = (uint32_t)index.size();
+
+    string buf((const char*)&h, sizeof(h));
+    uint32_t offset = 0;
+    for (auto &s : strings) { buf.append((const char*)&offset, 4); offset += (uint32_t)s.size(); }
+    buf.append((const char*)&offset, 4);
+    for (auto &s : strings) buf += s;
+    while (buf.size() % 8) buf.push_back('\0');
+    h.index_offset = buf.size();
+    uint64_t data = buf.size() + index.size() * sizeof(Key);
+    for (auto &k : index) { k.offset = data; data += k.size; }
+    buf.append((const char*)index.data(), index.size() * sizeof(Key));
+    for (auto &b : sealed) buf.append((const char*)b.bytes.data(), b.bytes.size());
+    if (last.events) buf.append((const char*)open.bytes.data(), used);
+    memcpy(&buf[0], &h, sizeof(h));
+
+    // a reader never sees a partial trace
+    return write_file_atomic(path, buf, err);
+}
+
+bool TraceReader::open(const string &p, string &err) {
+    path = p;
+    ifstream in(path, ios::binary);
+    if (!in) { err = "cannot open '" + path + "'"; return false; }
+    in.seekg(0, ios::end);
+    uint64_t size = (uint64_t)in.tellg();
+    in.seekg(0);
+    TraceHeader h;
+    if (size < sizeof(h) || !in.read((char*)&h, sizeof(h))) { err = "file too small"; return false; }
+    if (memcmp(h.magic, TRACE_MAGIC, sizeof(h.magic)) != 0) { err = "not a MiniC trace"; return false; }
+    if (h.endian_tag != ENDIAN_TAG) { err = "trace was written on a machine with different byte order"; return false; }
+    if (h.version != TRACE_VERSION) { err = "unsupported trace version " + to_string(h.version); return false; }
+    if (h.index_offset > size || (size - h.index_offset) / sizeof(TraceRecorder::Key) < h.block_count
+        || (h.index_offset - sizeof(h)) / 4 <= h.string_count) { err = "truncated or corrupt trace"; return false; }
+
+    vector<uint32_t> offsets(h.string_count + 1);
+    in.read((char*)offsets.data(), offsets.size() * 4);
+    string bytes(h.index_offset - sizeof(h) - offsets.size() * 4, '\0');
+    in.read(&bytes[0], bytes.size());
+    index.resize(h.block_count);
+    in.read((char*)index.data(), index.size() * sizeof(TraceRecorder::Key));
+    if (!in) { err = "truncated or corrupt trace"; return false; }
+    strings.clear();
+    for (uint32_t i=0;i<h.string_count;++i) {
+        if (offsets[i] > offsets[i+1] || offsets[i+1] > bytes.size()) { err = "corrupt string table"; return false; }
+        strings.push_back(bytes.substr(offsets[i], offsets[i+1] - offsets[i]));
+    }
+    uint64_t step = h.first_step;
+    for (auto &k : index) {
+        if (k.offset > size || size - k.offset < k.size || k.first_step != step || k.module >= strings.size()) { err = "corrupt trace index"; return false; }
+        step += k.events;
+    }
+    if (step != h.end_step) { err = "corrupt trace index"; return false; }
+    first = h.first_step; end = h.end_step;
+    return true;
+}
+
+bool TraceReader::read(uint64_t from, size_t count, vector<TraceEvent> &out, string &err) {
+    out.clear();
+    from = max(from, first);
+    if (from >= end || !count) return true;
+    // the block holding `from`: the last one starting at or before it
+    size_t b = upper_bound(index.begin(), index.end(), from, [](uint64_t s, const TraceRecorder::Key &k) { return s < k.first_step; }) - index.begin() - 1;
+
+    ifstream in(path, ios::binary);
+    if (!in) { err = "cannot open '" + path + "'"; return false; }
+    vector<uint8_t> bytes;
+    for (; b < index.size() && out.size() < count; ++b) {
+        const TraceRecorder::Key &k = index[b];
+        bytes.resize(k.size);
+        in.seekg((streamoff)k.offset);
+        if (!in.read((char*)bytes.data(), k.size)) { err = "truncated trace"; return false; }
+
+        Cursor c{bytes.data(), bytes.data() + bytes.size()};
+        int line = k.line, pos = k.pos; uint32_t depth = k.depth, module = k.module;
+        auto str = [&](uint64_t id) -> const string & {
+            if (id >= strings.size()) { c.ok = false; id = 0; }
+            return strings[id];
+        };
+        for (uint32_t n=0; n<k.events && out.size() < count; ++n) {
+            if (c.p >= c.end) { c.ok = false; break; }
+            uint8_t header = *c.p++;
+            TraceEvent ev;
+            ev.kind = (TraceEvent::Kind)(header & 7);
+            uint8_t tag = (header >> 3) & 7;
+            if (ev.kind > TraceEvent::RETURN) { c.ok = false; break; }
+            if (header & MODULE_CHANGED) { module = (uint32_t)c.varint(); str(module); }
+            if (ev.kind==TraceEvent::CALL || ev.kind==TraceEvent::WRITE || ev.kind==TraceEvent::INDEX_WRITE) ev.name = str(c.varint());
+            if (ev.kind==TraceEvent::STATEMENT || ev.kind==TraceEvent::CALL || ev.kind==TraceEvent::RETURN) { line += (int)c.svarint(); pos += (int)c.svarint(); }
+            if (ev.kind==TraceEvent::INDEX_WRITE) ev.index = c.svarint();
+            if (ev.kind==TraceEvent::CALL) ++depth;
+            if (ev.kind==TraceEvent::RETURN && depth) --depth;
+            switch (tag) {
+                case TAG_INT: ev.value.type = Value::INT; ev.value.i = c.svarint(); break;
+                case TAG_FLOAT: ev.value.type = Value::FLOAT; ev.value.f = c.f64(); break;
+                case TAG_FALSE: case TAG_TRUE: ev.value.type = Value::BOOL; ev.value.b = tag==TAG_TRUE; break;
+                case TAG_INT_ARRAY: case TAG_FLOAT_ARRAY:
+                    ev.value.type = tag==TAG_INT_ARRAY ? Value::INT_ARRAY : Value::FLOAT_ARRAY; ev.index = (long long)c.varint(); break;
+                default: ev.value.type = Value::NONE; break;
+            }
+            if (!c.ok) break;
+            ev.step = k.first_step + n;
+            if (ev.step < from) continue;
+            ev.line = line; ev.pos = pos; ev.depth = depth; ev.module = strings[module];
+            out.push_back(move(ev));
+        }
+        if (!c.ok) { err = "corrupt trace block at step " + to_string(k.first_step); return false; }
+    }
+    return true;
+}
+
+static string value_json(const TraceEvent &e) {
+    const Value &v = e.value;
+    if (v.type==Value::INT) return to_string(v.i);
+    if (v.type==Value::BOOL) return v.b ? "true" : "false";
+    if (v.type==Value::FLOAT && isfinite(v.f)) { ostringstream ss; ss.precision(17); ss << v.f; return ss.str(); }
+    return "null";
+}
+
+string trace_to_json(const TraceReader &reader, const vector<TraceEvent> &events) {
+    ostringstream out;
+    out << "{\n  \"first_step\": " << reader.first_step() << ",\n  \"end_step\": " << reader.end_step() << ",\n  \"events\": [\n";
+    for (size_t i=0;i<events.size();++i) {
+        const TraceEvent &e = events[i];
+        out << "    {\"step\": " << e.step << ", \"kind\": \"" << trace_kind_name(e.kind) << "\", \"line\": " << e.line << ", \"pos\": " << e.pos
+            << ", \"module\": \"" << escape_json(e.module) << "\", \"depth\": " << e.depth;
+        if (!e.name.empty()) out << ", \"name\": \"" << escape_json(e.name) << "\"";
+        if (e.kind==TraceEvent::INDEX_WRITE) out << ", \"index\": " << e.index;
+        if (e.kind==TraceEvent::WRITE || e.kind==TraceEvent::INDEX_WRITE || e.kind==TraceEvent::RETURN) {
+            out << ", \"value\": " << value_json(e);
+            if (e.value.is_array()) out << ", \"length\": " << e.index;
+        }
+        out << "}" << (i+1<events.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+    return out.str();
+}
@@ -0,0 +1,99 @@
+// Execution traces (minic_backend --trace=FILE, CompileOptions::trace) and the
+// reader behind --read-trace and minic_native.read_trace.
+//
+// The interpreter records one event per executed statement, variable write,
+// call and return. Events are packed into blocks: positions as zigzag varint
+// deltas from the previous position, names as ids into a string table, ints as
+// zigzag varints and floats as raw 8 bytes, so a statement costs 3 bytes in the
+// common case. Once trace_limit bytes are filled the oldest blocks are dropped,
+// keeping the most recent steps of a long run. Each block starts from a
+// keyframe (step, position, call depth, module) stored in the file's index, so
+// a reader seeks to any step by decoding at most one block.
+#pragma once
+
+#include "minic.h"
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct TraceEvent {
+    enum Kind { STATEMENT, WRITE, INDEX_WRITE, CALL, RETURN } kind = STATEMENT;
+    uint64_t step = 0;      // index in the whole run, dropped steps included
+    int line = 0, pos = 0;  // current statement, or the call site of a CALL / RETURN (Token::line / pos)
+    std::string module;     // whose source line/pos refer to; empty for the main program
+    unsigned depth = 0;     // calls in progress after the event
+    std::string name;       // variable written, or function called
+    long long index = 0;    // INDEX_WRITE: element; array values: their length
+    Value value;            // written or returned; arrays carry only their length (in index)
+};
+
+const char *trace_kind_name(TraceEvent::Kind k);
+
+// Recorder owned by the interpreter. Not thread-safe: a traced run executes
+// parallel for loops on one thread.
+class TraceRecorder {
+public:
+    explicit TraceRecorder(size_t limit_bytes);
+
+    uint32_t intern(const std::string &s);
+    void statement(int line, int pos, uint32_t module);
+    void call(uint32_t name, int line, int pos, uint32_t module);
+    // Back at the call site in the caller's module
+    void ret(const Value &v, int line, int pos, uint32_t module);
+    void write(uint32_t name, const Value &v);
+    void index_write(uint32_t name, long long index, const Value &v);
+
+    bool save(const std::string &path, std::string &err);
+
+    // Index entry of a block, and the decoder state it starts from
+    struct Key {
+        uint64_t first_step, offset;
+        uint32_t size, events;
+        int32_t line, pos;
+        uint32_t depth, module;
+    };
+
+private:
+    struct Block { Key key; std::vector<uint8_t> bytes; };
+
+    uint8_t *begin_event(uint8_t header) {
+        if (used + MAX_EVENT > block_size) seal();
+        uint8_t *p = open.bytes.data() + used;
+        *p++ = header;
+        return p;
+    }
+    void end_event(uint8_t *p) { used = (size_t)(p - open.bytes.data()); ++open.key.events; ++step; }
+    void position(uint8_t *&p, int new_line, int new_pos);
+    void seal();
+
+    static const size_t MAX_EVENT = 64;
+    size_t limit, block_size, used = 0, sealed_bytes = 0;
+    std::deque<Block> sealed;
+    Block open;
+    uint64_t step = 0;
+    int line = 0, pos = 0;
+    uint32_t depth = 0, module = 0;
+    std::vector<std::string> strings;
+    std::unordered_map<std::string, uint32_t> string_ids;
+};
+
+class TraceReader {
+public:
+    bool open(const std::string &path, std::string &err);
+    uint64_t first_step() const { return first; }  // earlier steps were dropped
+    uint64_t end_step() const { return end; }      // one past the last step
+    // Up to count events from step `from` on (from is clamped to first_step())
+    bool read(uint64_t from, size_t count, std::vector<TraceEvent> &out, std::string &err);
+
+private:
+    std::string path;
+    uint64_t first = 0, end = 0;
+    std::vector<std::string> strings;
+    std::vector<TraceRecorder::Key> index;
+};
+
+// {"first_step": .., "end_step": .., "events": [...]}, as printed by --read-trace
+std::string trace_to_json(const TraceReader &reader, const std::vector<TraceEvent> &events);